@@ -0,0 +1,427 @@
+#include "CpuSSAO.h"
+
+#include <cmath>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_SSAO_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CPU_SSAO_SSE2
+#endif
+
+namespace
+{
+	// One batch holds BatchWidth neighbouring pixels of a row; every kernel below is written against these
+	// helpers so the AVX2, SSE2 and scalar builds evaluate the same operations in the same order.
+#if defined(CPU_SSAO_AVX2)
+	typedef __m256 Batch;
+	constexpr int BatchWidth = 8;
+	inline Batch Set1(float v) { return _mm256_set1_ps(v); }
+	inline Batch Load(const float* p) { return _mm256_loadu_ps(p); }
+	inline void Store(float* p, Batch v) { _mm256_storeu_ps(p, v); }
+	inline Batch Add(Batch a, Batch b) { return _mm256_add_ps(a, b); }
+	inline Batch Sub(Batch a, Batch b) { return _mm256_sub_ps(a, b); }
+	inline Batch Mul(Batch a, Batch b) { return _mm256_mul_ps(a, b); }
+	inline Batch Div(Batch a, Batch b) { return _mm256_div_ps(a, b); }
+	inline Batch Min(Batch a, Batch b) { return _mm256_min_ps(a, b); }
+	inline Batch Max(Batch a, Batch b) { return _mm256_max_ps(a, b); }
+	inline Batch Sqrt(Batch a) { return _mm256_sqrt_ps(a); }
+	inline Batch Abs(Batch a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+	inline Batch Truncate(Batch a) { return _mm256_cvtepi32_ps(_mm256_cvttps_epi32(a)); }
+	// 1.0 where a >= b, 0.0 otherwise
+	inline Batch StepGreaterEqual(Batch a, Batch b) { return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ), _mm256_set1_ps(1.0f)); }
+	inline Batch StepGreater(Batch a, Batch b) { return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ), _mm256_set1_ps(1.0f)); }
+	// b where condition (a StepXxx result) is 1.0, a otherwise
+	inline Batch Select(Batch condition, Batch a, Batch b) { return _mm256_blendv_ps(a, b, _mm256_cmp_ps(condition, _mm256_setzero_ps(), _CMP_NEQ_OQ)); }
+	// base[index * stride] for every lane; index holds exact integers
+	inline Batch Gather(const float* base, Batch index, int stride)
+	{
+		__m256i offsets = _mm256_mullo_epi32(_mm256_cvttps_epi32(index), _mm256_set1_epi32(stride));
+		return _mm256_i32gather_ps(base, offsets, 4);
+	}
+#elif defined(CPU_SSAO_SSE2)
+	typedef __m128 Batch;
+	constexpr int BatchWidth = 4;
+	inline Batch Set1(float v) { return _mm_set1_ps(v); }
+	inline Batch Load(const float* p) { return _mm_loadu_ps(p); }
+	inline void Store(float* p, Batch v) { _mm_storeu_ps(p, v); }
+	inline Batch Add(Batch a, Batch b) { return _mm_add_ps(a, b); }
+	inline Batch Sub(Batch a, Batch b) { return _mm_sub_ps(a, b); }
+	inline Batch Mul(Batch a, Batch b) { return _mm_mul_ps(a, b); }
+	inline Batch Div(Batch a, Batch b) { return _mm_div_ps(a, b); }
+	inline Batch Min(Batch a, Batch b) { return _mm_min_ps(a, b); }
+	inline Batch Max(Batch a, Batch b) { return _mm_max_ps(a, b); }
+	inline Batch Sqrt(Batch a) { return _mm_sqrt_ps(a); }
+	inline Batch Abs(Batch a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+	inline Batch Truncate(Batch a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a)); }
+	inline Batch StepGreaterEqual(Batch a, Batch b) { return _mm_and_ps(_mm_cmpge_ps(a, b), _mm_set1_ps(1.0f)); }
+	inline Batch StepGreater(Batch a, Batch b) { return _mm_and_ps(_mm_cmpgt_ps(a, b), _mm_set1_ps(1.0f)); }
+	inline Batch Select(Batch condition, Batch a, Batch b)
+	{
+		__m128 mask = _mm_cmpneq_ps(condition, _mm_setzero_ps());
+		return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+	}
+	inline Batch Gather(const float* base, Batch index, int stride)
+	{
+		__m128i i = _mm_cvttps_epi32(index);
+		alignas(16) int lanes[4];
+		_mm_store_si128((__m128i*)lanes, i);
+		return _mm_set_ps(base[lanes[3] * stride], base[lanes[2] * stride], base[lanes[1] * stride], base[lanes[0] * stride]);
+	}
+#else
+	typedef float Batch;
+	constexpr int BatchWidth = 1;
+	inline Batch Set1(float v) { return v; }
+	inline Batch Load(const float* p) { return *p; }
+	inline void Store(float* p, Batch v) { *p = v; }
+	inline Batch Add(Batch a, Batch b) { return a + b; }
+	inline Batch Sub(Batch a, Batch b) { return a - b; }
+	inline Batch Mul(Batch a, Batch b) { return a * b; }
+	inline Batch Div(Batch a, Batch b) { return a / b; }
+	inline Batch Min(Batch a, Batch b) { return b < a ? b : a; }
+	inline Batch Max(Batch a, Batch b) { return b > a ? b : a; }
+	inline Batch Sqrt(Batch a) { return std::sqrt(a); }
+	inline Batch Abs(Batch a) { return std::fabs(a); }
+	inline Batch Truncate(Batch a) { return (float)(int)a; }
+	inline Batch StepGreaterEqual(Batch a, Batch b) { return a >= b ? 1.0f : 0.0f; }
+	inline Batch StepGreater(Batch a, Batch b) { return a > b ? 1.0f : 0.0f; }
+	inline Batch Select(Batch condition, Batch a, Batch b) { return condition != 0.0f ? b : a; }
+	inline Batch Gather(const float* base, Batch index, int stride) { return base[(int)index * stride]; }
+#endif
+
+	struct Vec3Batch
+	{
+		Batch x, y, z;
+	};
+
+	inline Batch Dot(const Vec3Batch& a, const Vec3Batch& b)
+	{
+		return Add(Add(Mul(a.x, b.x), Mul(a.y, b.y)), Mul(a.z, b.z));
+	}
+
+	inline Vec3Batch Normalize(const Vec3Batch& v)
+	{
+		Batch length = Sqrt(Dot(v, v));
+		return { Div(v.x, length), Div(v.y, length), Div(v.z, length) };
+	}
+
+	// GLSL smoothstep(0.0, 1.0, x)
+	inline Batch SmoothStep01(Batch x)
+	{
+		Batch t = Min(Max(x, Set1(0.0f)), Set1(1.0f));
+		return Mul(Mul(t, t), Sub(Set1(3.0f), Mul(Set1(2.0f), t)));
+	}
+
+	// nearest texel index along one axis of a clamp-to-edge texture, as an exact float
+	inline Batch TexelClamp(Batch coord, int size)
+	{
+		Batch texel = Mul(coord, Set1((float)size));
+		return Truncate(Min(Max(texel, Set1(0.0f)), Set1((float)(size - 1))));
+	}
+
+	// same constants as the shader
+	constexpr float Bias = 0.025f;
+	constexpr float HBAOAngleBias = 0.1f;
+	constexpr float Pi = 3.14159265f;
+
+	// horizonBasedAO() of the shader. Directions differ per pixel, so their setup runs per lane and only the
+	// step march is batched; skipped samples keep the running values through Select() rather than branches.
+	void hbaoRows(const float* position, const float* normal, int channels, int width, int height,
+	              const CpuSSAOParams& params, float* ao, int rowBegin, int rowEnd)
+	{
+		const float* P = params.projection;
+		int directions = params.hbaoDirections;
+		int steps = params.hbaoSteps;
+		float radius2 = params.radius * params.radius;
+		alignas(32) float fragX[BatchWidth], fragY[BatchWidth], fragZ[BatchWidth];
+		alignas(32) float texU[BatchWidth], stepPixels[BatchWidth], jitter[BatchWidth];
+		alignas(32) float dirX[BatchWidth], dirY[BatchWidth], maxSin[BatchWidth];
+		alignas(32) float randX[BatchWidth], randY[BatchWidth], slopeX[BatchWidth], slopeY[BatchWidth];
+		alignas(32) float result[BatchWidth];
+		bool unoccluded[BatchWidth];
+
+		for (int y = rowBegin; y < rowEnd; ++y)
+		{
+			float v = ((float)y + 0.5f) / (float)height;
+			float noiseV = v * params.noiseScaleY;
+			int noiseRow = (int)((noiseV - std::floor(noiseV)) * params.noiseSize);
+			noiseRow = noiseRow < params.noiseSize ? noiseRow : params.noiseSize - 1;
+
+			for (int x = 0; x < width; x += BatchWidth)
+			{
+				for (int lane = 0; lane < BatchWidth; ++lane)
+				{
+					int px = x + lane < width ? x + lane : width - 1;
+					const float* pos = position + ((size_t)y * width + px) * channels;
+					const float* nrm = normal + ((size_t)y * width + px) * channels;
+					fragX[lane] = pos[0]; fragY[lane] = pos[1]; fragZ[lane] = pos[2];
+					texU[lane] = ((float)px + 0.5f) / (float)width;
+
+					float noiseU = texU[lane] * params.noiseScaleX;
+					int noiseCol = (int)((noiseU - std::floor(noiseU)) * params.noiseSize);
+					noiseCol = noiseCol < params.noiseSize ? noiseCol : params.noiseSize - 1;
+					const float* rnd = params.noise + (noiseRow * params.noiseSize + noiseCol) * 3;
+					float rndLength = std::sqrt(rnd[0] * rnd[0] + rnd[1] * rnd[1] + rnd[2] * rnd[2]);
+					randX[lane] = rnd[0] / rndLength; randY[lane] = rnd[1] / rndLength;
+
+					float nrmLength = std::sqrt(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]);
+					float nz = nrm[2] / nrmLength;
+					nz = std::fabs(nz) < 1e-4f ? (nz < 0.0f ? -1e-4f : 1e-4f) : nz;
+					// tangent slope along dir is dot(slope, dir)
+					slopeX[lane] = -(nrm[0] / nrmLength) / nz;
+					slopeY[lane] = -(nrm[1] / nrmLength) / nz;
+
+					float radiusPixels = params.radius * P[5] * 0.5f * (float)height / -fragZ[lane];
+					radiusPixels = radiusPixels < 0.5f * (float)height ? radiusPixels : 0.5f * (float)height;
+					// NaN (empty G-buffer texels) counts as too small, like the shader's comparison
+					unoccluded[lane] = !(radiusPixels >= 1.0f);
+					stepPixels[lane] = unoccluded[lane] ? 0.0f : radiusPixels / (float)(steps + 1);
+					jitter[lane] = randX[lane] * 0.5f + 0.5f;
+				}
+				Vec3Batch fragPos = { Load(fragX), Load(fragY), Load(fragZ) };
+				Batch u0 = Load(texU);
+				Batch stepBatch = Load(stepPixels);
+				Batch jitterBatch = Load(jitter);
+				Batch radius2Batch = Set1(radius2);
+
+				Batch occlusion = Set1(0.0f);
+				for (int d = 0; d < directions; ++d)
+				{
+					float angle = 2.0f * Pi * (float)d / (float)directions;
+					float baseX = std::cos(angle), baseY = std::sin(angle);
+					for (int lane = 0; lane < BatchWidth; ++lane)
+					{
+						dirX[lane] = baseX * randX[lane] - baseY * randY[lane];
+						dirY[lane] = baseX * randY[lane] + baseY * randX[lane];
+						float tangentSlope = slopeX[lane] * dirX[lane] + slopeY[lane] * dirY[lane];
+						maxSin[lane] = std::sin(std::atan(tangentSlope) + HBAOAngleBias);
+					}
+					Batch dx = Load(dirX), dy = Load(dirY);
+					Batch horizon = Load(maxSin);
+					for (int s = 1; s <= steps; ++s)
+					{
+						Batch offset = Mul(Add(Set1((float)s), jitterBatch), stepBatch);
+						Batch u = Add(u0, Div(Mul(dx, offset), Set1((float)width)));
+						Batch v2 = Add(Set1(v), Div(Mul(dy, offset), Set1((float)height)));
+						Batch texel = Add(Mul(TexelClamp(v2, height), Set1((float)width)), TexelClamp(u, width));
+						Vec3Batch D = {
+							Sub(Gather(position + 0, texel, channels), fragPos.x),
+							Sub(Gather(position + 1, texel, channels), fragPos.y),
+							Sub(Gather(position + 2, texel, channels), fragPos.z)
+						};
+						Batch d2 = Dot(D, D);
+						Batch inRange = Mul(StepGreater(radius2Batch, d2), StepGreater(d2, Set1(1e-8f)));
+						Batch sinH = Div(D.z, Sqrt(Max(d2, Set1(1e-8f))));
+						Batch rises = Mul(inRange, StepGreater(sinH, horizon));
+						Batch contribution = Mul(Sub(Set1(1.0f), Div(d2, radius2Batch)), Sub(sinH, horizon));
+						occlusion = Select(rises, occlusion, Add(occlusion, contribution));
+						horizon = Select(rises, horizon, sinH);
+					}
+				}
+				occlusion = Sub(Set1(1.0f), Div(occlusion, Set1((float)directions)));
+				Store(result, Min(Max(occlusion, Set1(0.0f)), Set1(1.0f)));
+
+				int lanes = width - x < BatchWidth ? width - x : BatchWidth;
+				float* out = ao + (size_t)y * width + x;
+				for (int lane = 0; lane < lanes; ++lane)
+					out[lane] = std::pow(unoccluded[lane] ? 1.0f : result[lane], params.power);
+			}
+		}
+	}
+
+	void occlusionRows(const float* position, const float* normal, int channels, int width, int height,
+	                   const CpuSSAOParams& params, float* ao, int rowBegin, int rowEnd)
+	{
+		const float* P = params.projection;
+		alignas(32) float fragX[BatchWidth], fragY[BatchWidth], fragZ[BatchWidth];
+		alignas(32) float normX[BatchWidth], normY[BatchWidth], normZ[BatchWidth];
+		alignas(32) float randX[BatchWidth], randY[BatchWidth], randZ[BatchWidth];
+		alignas(32) float result[BatchWidth];
+
+		for (int y = rowBegin; y < rowEnd; ++y)
+		{
+			float v = ((float)y + 0.5f) / (float)height;
+			float noiseV = v * params.noiseScaleY;
+			int noiseRow = (int)((noiseV - std::floor(noiseV)) * params.noiseSize);
+			noiseRow = noiseRow < params.noiseSize ? noiseRow : params.noiseSize - 1;
+
+			for (int x = 0; x < width; x += BatchWidth)
+			{
+				// gather the batch in SoA form; lanes past the row end repeat the last pixel and are discarded
+				for (int lane = 0; lane < BatchWidth; ++lane)
+				{
+					int px = x + lane < width ? x + lane : width - 1;
+					const float* pos = position + ((size_t)y * width + px) * channels;
+					const float* nrm = normal + ((size_t)y * width + px) * channels;
+					fragX[lane] = pos[0]; fragY[lane] = pos[1]; fragZ[lane] = pos[2];
+					normX[lane] = nrm[0]; normY[lane] = nrm[1]; normZ[lane] = nrm[2];
+
+					float u = ((float)px + 0.5f) / (float)width;
+					float noiseU = u * params.noiseScaleX;
+					int noiseCol = (int)((noiseU - std::floor(noiseU)) * params.noiseSize);
+					noiseCol = noiseCol < params.noiseSize ? noiseCol : params.noiseSize - 1;
+					const float* rnd = params.noise + (noiseRow * params.noiseSize + noiseCol) * 3;
+					randX[lane] = rnd[0]; randY[lane] = rnd[1]; randZ[lane] = rnd[2];
+				}
+				Vec3Batch fragPos = { Load(fragX), Load(fragY), Load(fragZ) };
+				Vec3Batch n = Normalize({ Load(normX), Load(normY), Load(normZ) });
+				Vec3Batch randomVec = Normalize({ Load(randX), Load(randY), Load(randZ) });
+
+				Batch rn = Dot(randomVec, n);
+				Vec3Batch tangent = Normalize({ Sub(randomVec.x, Mul(n.x, rn)), Sub(randomVec.y, Mul(n.y, rn)), Sub(randomVec.z, Mul(n.z, rn)) });
+				Vec3Batch bitangent = {
+					Sub(Mul(n.y, tangent.z), Mul(n.z, tangent.y)),
+					Sub(Mul(n.z, tangent.x), Mul(n.x, tangent.z)),
+					Sub(Mul(n.x, tangent.y), Mul(n.y, tangent.x))
+				};
+
+				Batch radius = Set1(params.radius);
+				Batch occlusion = Set1(0.0f);
+				for (int i = 0; i < params.kernelSize; ++i)
+				{
+					Batch sx = Set1(params.samples[i * 3 + 0]);
+					Batch sy = Set1(params.samples[i * 3 + 1]);
+					Batch sz = Set1(params.samples[i * 3 + 2]);
+					// TBN * sample, then offset around the fragment
+					Vec3Batch samplePos = {
+						Add(fragPos.x, Mul(Add(Add(Mul(tangent.x, sx), Mul(bitangent.x, sy)), Mul(n.x, sz)), radius)),
+						Add(fragPos.y, Mul(Add(Add(Mul(tangent.y, sx), Mul(bitangent.y, sy)), Mul(n.y, sz)), radius)),
+						Add(fragPos.z, Mul(Add(Add(Mul(tangent.z, sx), Mul(bitangent.z, sy)), Mul(n.z, sz)), radius))
+					};
+					// projection * vec4(samplePos, 1.0), perspective divide, to [0, 1]
+					Batch clipX = Add(Add(Add(Mul(Set1(P[0]), samplePos.x), Mul(Set1(P[4]), samplePos.y)), Mul(Set1(P[8]), samplePos.z)), Set1(P[12]));
+					Batch clipY = Add(Add(Add(Mul(Set1(P[1]), samplePos.x), Mul(Set1(P[5]), samplePos.y)), Mul(Set1(P[9]), samplePos.z)), Set1(P[13]));
+					Batch clipW = Add(Add(Add(Mul(Set1(P[3]), samplePos.x), Mul(Set1(P[7]), samplePos.y)), Mul(Set1(P[11]), samplePos.z)), Set1(P[15]));
+					Batch u = Add(Mul(Div(clipX, clipW), Set1(0.5f)), Set1(0.5f));
+					Batch v = Add(Mul(Div(clipY, clipW), Set1(0.5f)), Set1(0.5f));
+
+					Batch texel = Add(Mul(TexelClamp(v, height), Set1((float)width)), TexelClamp(u, width));
+					Batch sampleDepth = Gather(position + 2, texel, channels);
+
+					Batch rangeCheckValue = params.rangeCheck ? SmoothStep01(Div(radius, Abs(Sub(sampleDepth, samplePos.z)))) : Set1(1.0f);
+					occlusion = Add(occlusion, Mul(StepGreaterEqual(sampleDepth, Add(samplePos.z, Set1(Bias))), rangeCheckValue));
+				}
+				occlusion = Sub(Set1(1.0f), Div(occlusion, Set1((float)params.kernelSize)));
+				Store(result, occlusion);
+
+				int lanes = width - x < BatchWidth ? width - x : BatchWidth;
+				float* out = ao + (size_t)y * width + x;
+				for (int lane = 0; lane < lanes; ++lane)
+				{
+					float value = result[lane];
+					out[lane] = value >= 0.5f && !params.hemisphereKernel ? 1.0f : std::pow(value, params.power);
+				}
+			}
+		}
+	}
+
+	inline int wrap(int i, int size)
+	{
+		i %= size;
+		return i < 0 ? i + size : i;
+	}
+
+	// 4x4 box over offsets -2..1 with repeat addressing, accumulated in the shader's x-outer, y-inner order
+	void blurRows(const float* ao, int width, int height, float* blurred, int rowBegin, int rowEnd)
+	{
+		for (int y = rowBegin; y < rowEnd; ++y)
+		{
+			const float* rows[4];
+			for (int dy = -2; dy < 2; ++dy)
+				rows[dy + 2] = ao + (size_t)wrap(y + dy, height) * width;
+			float* out = blurred + (size_t)y * width;
+
+			int x = 0;
+			for (; x < 2 && x < width; ++x)
+			{
+				float result = 0.0f;
+				for (int dx = -2; dx < 2; ++dx)
+					for (int dy = 0; dy < 4; ++dy)
+						result += rows[dy][wrap(x + dx, width)];
+				out[x] = result * 0.0625f;
+			}
+			for (; x + BatchWidth + 1 <= width; x += BatchWidth)
+			{
+				Batch result = Set1(0.0f);
+				for (int dx = -2; dx < 2; ++dx)
+					for (int dy = 0; dy < 4; ++dy)
+						result = Add(result, Load(rows[dy] + x + dx));
+				Store(out + x, Mul(result, Set1(0.0625f)));
+			}
+			for (; x < width; ++x)
+			{
+				float result = 0.0f;
+				for (int dx = -2; dx < 2; ++dx)
+					for (int dy = 0; dy < 4; ++dy)
+						result += rows[dy][wrap(x + dx, width)];
+				out[x] = result * 0.0625f;
+			}
+		}
+	}
+}
+
+CpuSSAO::CpuSSAO(unsigned int threadCount)
+{
+	pool = new ThreadPool(threadCount);
+}
+
+CpuSSAO::~CpuSSAO()
+{
+	delete pool;
+}
+
+void CpuSSAO::SetThreadCount(unsigned int threadCount)
+{
+	delete pool;
+	pool = new ThreadPool(threadCount);
+}
+
+unsigned int CpuSSAO::GetThreadCount() const
+{
+	return pool->Size();
+}
+
+const char* CpuSSAO::GetSimdName()
+{
+#if defined(CPU_SSAO_AVX2)
+	return "AVX2";
+#elif defined(CPU_SSAO_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+void CpuSSAO::Occlusion(const float* position, const float* normal, int channels, int width, int height,
+                        const CpuSSAOParams& params, float* ao)
+{
+	if (params.aoMethod == 0)
+	{
+		for (size_t i = 0; i < (size_t)width * height; ++i)
+			ao[i] = 1.0f;
+		return;
+	}
+	pool->ParallelFor(0, height, 4, [&](int rowBegin, int rowEnd)
+	{
+		if (params.aoMethod == 2)
+			hbaoRows(position, normal, channels, width, height, params, ao, rowBegin, rowEnd);
+		else
+			occlusionRows(position, normal, channels, width, height, params, ao, rowBegin, rowEnd);
+	});
+}
+
+void CpuSSAO::Blur(const float* ao, int width, int height, bool enableBlur, float* blurred)
+{
+	if (!enableBlur)
+	{
+		for (size_t i = 0; i < (size_t)width * height; ++i)
+			blurred[i] = ao[i];
+		return;
+	}
+	pool->ParallelFor(0, height, 16, [&](int rowBegin, int rowEnd)
+	{
+		blurRows(ao, width, height, blurred, rowBegin, rowEnd);
+	});
+}
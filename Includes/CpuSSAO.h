@@ -0,0 +1,50 @@
+#ifndef CPU_SSAO_H
+#define CPU_SSAO_H
+
+#include "ThreadPool.h"
+
+// Parameters of one occlusion evaluation; mirror the uniforms of SSAOOcclusionFShader.fs
+struct CpuSSAOParams
+{
+    int aoMethod = 2;               // 0: None, 1: SSAO, 2: HBAO
+    int kernelSize = 64;
+    float radius = 1.0f;
+    bool rangeCheck = true;
+    float power = 1.0f;
+    int hbaoDirections = 8;
+    int hbaoSteps = 6;
+    const float* projection = nullptr; // column-major 4x4 (glm::value_ptr)
+    const float* samples = nullptr;    // kernelSize xyz triplets (SSAO only)
+    bool hemisphereKernel = false;     // false: sphere kernel, unoccluded fractions of one half or more become 1
+    const float* noise = nullptr;      // noiseSize * noiseSize xyz triplets, row-major like the noise texture
+    int noiseSize = 4;
+    float noiseScaleX = 1.0f;          // target width / noiseSize, as the shader derives 'noiseScale'
+    float noiseScaleY = 1.0f;          // target height / noiseSize
+};
+
+// CPU reference of the occlusion and blur passes.
+// Computes what SSAOOcclusionFShader.fs and SSAOBlurFShader.fs compute (nearest filtering, clamp-to-edge
+// G-buffer, repeating noise and AO input), vectorized across pixels with AVX2/SSE2 and split by rows over a thread pool.
+// Used as a golden reference for the GPU passes and as a fallback where there is no GPU.
+class CpuSSAO
+{
+public:
+    // threadCount of 0 uses every hardware thread
+    explicit CpuSSAO(unsigned int threadCount = 0);
+    ~CpuSSAO();
+
+    void SetThreadCount(unsigned int threadCount);
+    unsigned int GetThreadCount() const;
+    // name of the instruction set the kernels were compiled for
+    static const char* GetSimdName();
+
+    // position/normal: width * height pixels with 'channels' floats each (3 or 4), bottom row first like GL textures
+    void Occlusion(const float* position, const float* normal, int channels, int width, int height,
+                   const CpuSSAOParams& params, float* ao);
+    void Blur(const float* ao, int width, int height, bool enableBlur, float* blurred);
+
+private:
+    ThreadPool* pool;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <algorithm>
+#include <cmath>
+
+// Picks the render scale (fraction of the output width and height) that keeps the GPU time of a frame under a
+// budget. Measured times are smoothed, the scale only drops once the smoothed time is over the budget and only
+// rises once it has stayed below budget * (1 - headroom) for a while, and every change waits for timings that
+// were taken at the new scale, so the scale does not flip between two sizes from one frame to the next.
+class DynamicResolution
+{
+public:
+    static constexpr float MinScale = 0.5f;
+    static constexpr float MaxScale = 1.0f;
+    static constexpr float ScaleStep = 0.05f; // scales are multiples of this, so each size comes back out of the texture pool
+
+    float budgetMs = 8.0f;
+    float headroom = 0.15f;  // fraction of the budget that has to be free before the scale goes up
+    int settleFrames = 8;    // frames after a change whose timings may still come from the old scale
+    int raiseFrames = 30;    // frames the time has to stay under the raise threshold
+
+    // gpuMs: total GPU time of the most recent frame with results, 0 when there was none; returns the new scale
+    float Update(float gpuMs)
+    {
+        if (gpuMs <= 0.0f)
+            return scale;
+        smoothedMs = smoothedMs > 0.0f ? smoothedMs + 0.2f * (gpuMs - smoothedMs) : gpuMs;
+        if (settle > 0)
+        {
+            --settle;
+            return scale;
+        }
+        if (smoothedMs > budgetMs)
+        {
+            // cost follows the pixel count, so the side length scales with the square root of the time ratio
+            setScale(scale * std::sqrt(budgetMs / smoothedMs), false);
+            underBudget = 0;
+        }
+        else if (smoothedMs < budgetMs * (1.0f - headroom))
+        {
+            if (++underBudget >= raiseFrames)
+            {
+                setScale(scale + ScaleStep, true);
+                underBudget = 0;
+            }
+        }
+        else
+        {
+            underBudget = 0;
+        }
+        return scale;
+    }
+
+    void Reset(float newScale = MaxScale)
+    {
+        scale = Quantize(newScale);
+        smoothedMs = 0.0f;
+        settle = 0;
+        underBudget = 0;
+    }
+
+    float GetScale() const { return scale; }
+    float GetSmoothedMs() const { return smoothedMs; }
+    // budget minus the smoothed GPU time; negative while over budget
+    float GetHeadroomMs() const { return budgetMs - smoothedMs; }
+
+    static float Quantize(float value)
+    {
+        return std::min(MaxScale, std::max(MinScale, std::round(value / ScaleStep) * ScaleStep));
+    }
+
+private:
+    float scale = MaxScale;
+    float smoothedMs = 0.0f;
+    int settle = 0;
+    int underBudget = 0;
+
+    void setScale(float value, bool up)
+    {
+        // going down always moves at least one step, going up exactly one
+        float quantized = up ? Quantize(value) : std::min(Quantize(value), Quantize(scale - ScaleStep));
+        if (quantized == scale)
+            return;
+        scale = quantized;
+        settle = settleFrames;
+    }
+};
+
+#endif
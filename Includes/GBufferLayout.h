@@ -0,0 +1,78 @@
+#ifndef GBUFFER_LAYOUT_H
+#define GBUFFER_LAYOUT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// Selectable G-buffer layouts, from the original wide formats to the cheapest one
+enum GBufferProfileId
+{
+    GBUFFER_REFERENCE = 0, // RGBA16F xyz normals, R16F AO result
+    GBUFFER_OCT16 = 1,     // octahedral normals in RG16, R8 AO result
+    GBUFFER_OCT8 = 2,      // octahedral normals in RG8, R8 AO result
+    GBUFFER_PROFILE_COUNT
+};
+
+// Formats of one profile; octahedral normals are stored remapped to [0, 1] because the SNORM formats are not
+// required to be renderable before GL 4.4
+struct GBufferLayout
+{
+    const char* name;
+    GLenum normalFormat;
+    GLenum normalDataFormat;
+    int normalBytes;
+    bool octahedralNormals;
+    GLenum aoFormat; // final AO the lighting pass reads
+    int aoBytes;
+};
+
+inline const GBufferLayout& GetGBufferLayout(int profile)
+{
+    static const GBufferLayout layouts[GBUFFER_PROFILE_COUNT] = {
+        { "RGBA16F normals", GL_RGBA16F, GL_RGBA, 8, false, GL_R16F, 2 },
+        { "Oct RG16 normals", GL_RG16, GL_RG, 4, true, GL_R8, 1 },
+        { "Oct RG8 normals", GL_RG8, GL_RG, 2, true, GL_R8, 1 },
+    };
+    return layouts[profile];
+}
+
+// Per-frame traffic of the G-buffer and the AO result at full resolution, in bytes per pixel
+struct GBufferBandwidth
+{
+    int geometryWrite; // depth + normal (+ albedo)
+    int lightingRead;  // depth + normal (+ albedo) + AO
+    int aoWrite;
+    double MegabytesPerFrame(int width, int height) const
+    {
+        return (double)(geometryWrite + lightingRead + aoWrite) * width * height / (1024.0 * 1024.0);
+    }
+};
+
+// hasAlbedo: whether the material set writes a per-pixel albedo; a constant one needs no attachment
+inline GBufferBandwidth GetGBufferBandwidth(const GBufferLayout& layout, bool hasAlbedo)
+{
+    const int depthBytes = 4; // GL_DEPTH_COMPONENT32F
+    const int albedoBytes = hasAlbedo ? 4 : 0; // RGBA8
+    GBufferBandwidth bandwidth;
+    bandwidth.geometryWrite = depthBytes + layout.normalBytes + albedoBytes;
+    bandwidth.lightingRead = depthBytes + layout.normalBytes + albedoBytes + layout.aoBytes;
+    bandwidth.aoWrite = layout.aoBytes;
+    return bandwidth;
+}
+
+// Inverse of the shaders' octEncode() after the [0, 1] storage remap
+inline glm::vec3 DecodeOctahedralNormal(float u, float v)
+{
+    float x = u * 2.0f - 1.0f, y = v * 2.0f - 1.0f;
+    glm::vec3 n = glm::vec3(x, y, 1.0f - std::fabs(x) - std::fabs(y));
+    if (n.z < 0.0f)
+    {
+        n.x = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        n.y = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::normalize(n);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef GL_COMPUTE_H
+#define GL_COMPUTE_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+
+// GL 4.3 compute entry points, loaded only on contexts that report 4.3 or later
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_TEXTURE_FETCH_BARRIER_BIT
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#endif
+#ifndef GL_TEXTURE_UPDATE_BARRIER_BIT
+#define GL_TEXTURE_UPDATE_BARRIER_BIT 0x00000100
+#endif
+
+struct GLCompute
+{
+    typedef void (APIENTRYP DispatchComputeProc)(GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ);
+    typedef void (APIENTRYP BindImageTextureProc)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer,
+                                                  GLenum access, GLenum format);
+    typedef void (APIENTRYP MemoryBarrierProc)(GLbitfield barriers);
+
+    DispatchComputeProc dispatchCompute = nullptr;
+    BindImageTextureProc bindImageTexture = nullptr;
+    MemoryBarrierProc memoryBarrier = nullptr;
+    int contextMajor = 0, contextMinor = 0;
+
+    // true when the current context is 4.3+ and exposes every entry point
+    bool Load(GLADloadproc load)
+    {
+        glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+        glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+        if (!HasGLVersion(4, 3))
+            return false;
+        dispatchCompute = (DispatchComputeProc)load("glDispatchCompute");
+        bindImageTexture = (BindImageTextureProc)load("glBindImageTexture");
+        memoryBarrier = (MemoryBarrierProc)load("glMemoryBarrier");
+        return dispatchCompute && bindImageTexture && memoryBarrier;
+    }
+};
+
+#endif
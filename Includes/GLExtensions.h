@@ -0,0 +1,39 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// The glad loader is generated for 3.3 core, so entry points of later versions and extensions are resolved at
+// runtime through the same proc address function, once one of these checks says the current context has them.
+
+// true when the current context reports at least major.minor
+inline bool HasGLVersion(int major, int minor)
+{
+    GLint contextMajor = 0, contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+// true when the current context lists the extension, e.g. "GL_ARB_texture_storage"
+inline bool HasGLExtension(const char* extension)
+{
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount; ++i)
+    {
+        if (std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), extension) == 0)
+            return true;
+    }
+    return false;
+}
+
+// true when the feature is core in major.minor or exposed by the extension on an older context
+inline bool HasGLVersionOrExtension(int major, int minor, const char* extension)
+{
+    return HasGLVersion(major, minor) || HasGLExtension(extension);
+}
+
+#endif
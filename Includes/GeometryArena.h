@@ -0,0 +1,286 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+#include "Mesh.h"
+#include "InstanceBuffer.h"
+#include "VertexLayout.h"
+
+#include <limits>
+#include <vector>
+
+// glMultiDrawElementsIndirect (GL 4.3 / ARB_multi_draw_indirect)
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+struct GLMultiDrawIndirect
+{
+    typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+
+    MultiDrawElementsIndirectProc multiDrawElementsIndirect = nullptr;
+
+    bool Load(GLADloadproc load)
+    {
+        if (!HasGLVersionOrExtension(4, 3, "GL_ARB_multi_draw_indirect"))
+            return false;
+        multiDrawElementsIndirect = (MultiDrawElementsIndirectProc)load("glMultiDrawElementsIndirect");
+        return multiDrawElementsIndirect != nullptr;
+    }
+};
+
+// Layout of a glMultiDrawElementsIndirect record
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// All meshes of a model packed into shared vertex buffers and one index buffer behind a single VAO. Each mesh is
+// an indirect command (its index range plus the base vertex of its vertices). Commands are sorted by material,
+// meaning the set of textures the mesh binds. A draw is one glMultiDrawElementsIndirect for the whole model when
+// the shader samples no material textures, or one per material when it does. Without multi-draw indirect the
+// commands stay on the CPU and are issued as glDrawElementsInstancedBaseVertex calls from the same VAO. Vertices
+// are stored in the streams of a VertexLayout, picked at construction, e.g.
+// GeometryArena(meshes, QuantizedVertexLayout(), mdi); a second VAO reads the position stream alone for depth-only
+// passes.
+class GeometryArena
+{
+public:
+    // multiDraw may be unloaded; the indirect buffer is only created when it is not
+    template <typename Layout>
+    GeometryArena(const std::vector<Mesh>& meshes, Layout, const GLMultiDrawIndirect& multiDraw)
+        : mdi(multiDraw)
+    {
+        std::vector<typename Layout::Position> positions;
+        std::vector<typename Layout::Attributes> attributes;
+        std::vector<unsigned int> indices;
+        computeBounds(meshes, Layout::QuantizedPositions);
+        // group meshes by material so each material is one contiguous range of commands
+        std::vector<std::vector<unsigned int>> materialMeshes;
+        for (unsigned int i = 0; i < meshes.size(); ++i)
+        {
+            int material = findMaterial(meshes[i]);
+            if (material < 0)
+            {
+                material = (int)materials.size();
+                materials.push_back({ &meshes[i], 0, 0 });
+                materialMeshes.emplace_back();
+            }
+            materialMeshes[material].push_back(i);
+        }
+        for (unsigned int material = 0; material < materials.size(); ++material)
+        {
+            materials[material].firstCommand = (int)commands.size();
+            for (unsigned int meshIndex : materialMeshes[material])
+            {
+                const Mesh& mesh = meshes[meshIndex];
+                DrawElementsIndirectCommand command;
+                command.count = (GLuint)mesh.indices.size();
+                command.instanceCount = 1;
+                command.firstIndex = (GLuint)indices.size();
+                command.baseVertex = (GLint)positions.size();
+                command.baseInstance = 0;
+                commands.push_back(command);
+                for (const Vertex& vertex : mesh.vertices)
+                {
+                    positions.emplace_back();
+                    attributes.emplace_back();
+                    Layout::Encode(vertex, (vertex.Position - positionOffset) / positionScale, positions.back(), attributes.back());
+                }
+                indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+            }
+            materials[material].commandCount = (int)commands.size() - materials[material].firstCommand;
+        }
+        layoutName = Layout::Name;
+        bytesPerVertex = (int)(sizeof(typename Layout::Position) + sizeof(typename Layout::Attributes));
+        vertexCount = (int)positions.size();
+
+        glGenVertexArrays(1, &VAO);
+        glGenVertexArrays(1, &positionVAO);
+        glGenBuffers(1, &positionVBO);
+        glGenBuffers(1, &attributeVBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(positions[0]), positions.empty() ? nullptr : &positions[0], GL_STATIC_DRAW);
+        Layout::PositionStream::Enable();
+        glBindBuffer(GL_ARRAY_BUFFER, attributeVBO);
+        glBufferData(GL_ARRAY_BUFFER, attributes.size() * sizeof(attributes[0]), attributes.empty() ? nullptr : &attributes[0], GL_STATIC_DRAW);
+        Layout::AttributeStream::Enable();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.empty() ? nullptr : &indices[0], GL_STATIC_DRAW);
+        glBindVertexArray(positionVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        Layout::PositionStream::Enable();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        setupIndirectBuffer();
+    }
+
+    ~GeometryArena()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteVertexArrays(1, &positionVAO);
+        glDeleteBuffers(1, &positionVBO);
+        glDeleteBuffers(1, &attributeVBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &indirectBuffer);
+    }
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // adds the per-instance attributes of instances to the arena's VAOs, see Mesh::SetInstanceBuffer
+    void SetInstanceBuffer(const InstanceBuffer& instances)
+    {
+        glBindVertexArray(VAO);
+        instances.BindAttributes();
+        glBindVertexArray(positionVAO);
+        instances.BindAttributes();
+        glBindVertexArray(0);
+    }
+
+    // draws every mesh instanceCount times; bindMaterials: the shader samples the mesh textures. positionsOnly
+    // fetches the position stream alone. Returns the number of draw calls issued.
+    int Draw(Shader& shader, int instanceCount, bool bindMaterials, bool positionsOnly = false)
+    {
+        setInstanceCount(instanceCount);
+        glBindVertexArray(positionsOnly ? positionVAO : VAO);
+        int draws = 0;
+        if (!bindMaterials)
+        {
+            draws += drawCommands(0, (int)commands.size());
+        }
+        else
+        {
+            for (const Material& material : materials)
+            {
+                material.mesh->BindTextures(shader);
+                draws += drawCommands(material.firstCommand, material.commandCount);
+            }
+            glActiveTexture(GL_TEXTURE0);
+        }
+        glBindVertexArray(0);
+        return draws;
+    }
+
+    int GetCommandCount() const { return (int)commands.size(); }
+    int GetMaterialCount() const { return (int)materials.size(); }
+    const char* GetLayoutName() const { return layoutName; }
+    // bytes the vertex shader fetches per vertex, over both streams
+    int GetBytesPerVertex() const { return bytesPerVertex; }
+    int GetVertexCount() const { return vertexCount; }
+    // model-space position = positionOffset + positionScale * stored position; identity unless the layout quantizes
+    const glm::vec3& GetPositionScale() const { return positionScale; }
+    const glm::vec3& GetPositionOffset() const { return positionOffset; }
+
+private:
+    struct Material
+    {
+        const Mesh* mesh; // first mesh with these textures, binds them
+        int firstCommand;
+        int commandCount;
+    };
+
+    unsigned int VAO = 0, positionVAO = 0, positionVBO = 0, attributeVBO = 0, EBO = 0, indirectBuffer = 0;
+    GLMultiDrawIndirect mdi;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<Material> materials;
+    int uploadedInstanceCount = 1;
+    const char* layoutName = "";
+    int bytesPerVertex = 0, vertexCount = 0;
+    glm::vec3 positionScale = glm::vec3(1.0f), positionOffset = glm::vec3(0.0f);
+
+    // quantized positions are stored relative to the bounds of every mesh in the arena, since a whole arena is
+    // drawn with one set of uniforms
+    void computeBounds(const std::vector<Mesh>& meshes, bool quantized)
+    {
+        if (!quantized)
+            return;
+        glm::vec3 low(std::numeric_limits<float>::max()), high(-std::numeric_limits<float>::max());
+        for (const Mesh& mesh : meshes)
+        {
+            for (const Vertex& vertex : mesh.vertices)
+            {
+                low = glm::min(low, vertex.Position);
+                high = glm::max(high, vertex.Position);
+            }
+        }
+        if (low.x > high.x)
+            return; // no vertices
+        positionOffset = low;
+        positionScale = glm::max(high - low, glm::vec3(1e-6f));
+    }
+
+    int findMaterial(const Mesh& mesh) const
+    {
+        for (unsigned int material = 0; material < materials.size(); ++material)
+        {
+            const std::vector<Texture>& textures = materials[material].mesh->textures;
+            if (textures.size() != mesh.textures.size())
+                continue;
+            bool same = true;
+            for (unsigned int i = 0; i < textures.size() && same; ++i)
+                same = textures[i].id == mesh.textures[i].id && textures[i].type == mesh.textures[i].type;
+            if (same)
+                return (int)material;
+        }
+        return -1;
+    }
+
+    // GL_DRAW_INDIRECT_BUFFER is not a valid target before GL 4.0 / ARB_draw_indirect
+    void setupIndirectBuffer()
+    {
+        if (!mdi.multiDrawElementsIndirect || commands.empty())
+            return;
+        glGenBuffers(1, &indirectBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0], GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // the instance count is part of every command; only rewritten when the grid changes
+    void setInstanceCount(int instanceCount)
+    {
+        if (instanceCount == uploadedInstanceCount)
+            return;
+        for (DrawElementsIndirectCommand& command : commands)
+            command.instanceCount = (GLuint)instanceCount;
+        if (indirectBuffer)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0]);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        uploadedInstanceCount = instanceCount;
+    }
+
+    int drawCommands(int first, int count)
+    {
+        if (count == 0)
+            return 0;
+        if (mdi.multiDrawElementsIndirect)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            mdi.multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(first * sizeof(DrawElementsIndirectCommand)), count, 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            return 1;
+        }
+        for (int i = first; i < first + count; ++i)
+        {
+            const DrawElementsIndirectCommand& command = commands[i];
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, (void*)(command.firstIndex * sizeof(unsigned int)),
+                                              command.instanceCount, command.baseVertex);
+        }
+        return count;
+    }
+};
+
+#endif
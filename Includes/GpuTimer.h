@@ -0,0 +1,173 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+// Per-pass GPU timings from GL_TIME_ELAPSED queries.
+// Each pass owns one query per in-flight frame; results are read FRAME_LATENCY frames later and only when
+// GL_QUERY_RESULT_AVAILABLE says so, so reading them never stalls the pipeline. A frame whose queries have not
+// all resolved by then is dropped rather than recorded partially.
+class GpuTimer
+{
+public:
+    static constexpr int FRAME_LATENCY = 3;
+
+    GpuTimer(const std::vector<std::string>& passNames, int historySize = 120)
+        : names(passNames), historySize(historySize)
+    {
+        int passCount = (int)names.size();
+        queries.resize(FRAME_LATENCY * passCount);
+        issued.assign(FRAME_LATENCY * passCount, false);
+        history.assign(passCount * historySize, 0.0f);
+        last.assign(passCount, 0.0f);
+        passSamples.assign(passCount, 0);
+        glGenQueries((int)queries.size(), &queries[0]);
+    }
+
+    ~GpuTimer()
+    {
+        CloseCsv();
+        glDeleteQueries((int)queries.size(), &queries[0]);
+    }
+
+    // call once at the start of every frame, before any Begin()
+    void BeginFrame()
+    {
+        ++frame;
+        slot = frame % FRAME_LATENCY;
+        int passCount = GetPassCount();
+        // this slot was last written FRAME_LATENCY frames ago
+        bool anyIssued = false, complete = true;
+        for (int pass = 0; pass < passCount && complete; ++pass)
+        {
+            int index = slot * passCount + pass;
+            if (!issued[index])
+                continue;
+            anyIssued = true;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+            complete = available != 0;
+        }
+        // Begin() reissues the queries of this slot, so a frame that has not resolved by now is dropped as a whole
+        // rather than mixed with older results of its missing passes
+        if (anyIssued && complete)
+            collect();
+        for (int pass = 0; pass < passCount; ++pass)
+            issued[slot * passCount + pass] = false;
+    }
+
+    void Begin(int pass)
+    {
+        int index = slot * GetPassCount() + pass;
+        glBeginQuery(GL_TIME_ELAPSED, queries[index]);
+        issued[index] = true;
+    }
+
+    void End()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    int GetPassCount() const { return (int)names.size(); }
+    const std::string& GetPassName(int pass) const { return names[pass]; }
+
+    // rolling statistics over the last historySize collected frames that ran the pass, in milliseconds
+    float GetMin(int pass) const { return reduce(pass, 0); }
+    float GetAvg(int pass) const { return reduce(pass, 1); }
+    float GetMax(int pass) const { return reduce(pass, 2); }
+    float GetLast(int pass) const { return last[pass]; }
+    // frames collected so far; GetLast() holds a new frame whenever this changes
+    long long GetSampleCount() const { return samples; }
+
+    // streams one row per collected frame: frame, then one column per pass in ms, empty when it did not run
+    bool OpenCsv(const std::string& path)
+    {
+        CloseCsv();
+        csv.open(path);
+        if (!csv)
+        {
+            std::cout << "ERROR::GPU_TIMER::FAILED_TO_OPEN " << path << std::endl;
+            return false;
+        }
+        csv << "frame";
+        for (const std::string& name : names)
+            csv << "," << name;
+        csv << "\n";
+        return true;
+    }
+
+    void CloseCsv()
+    {
+        if (csv.is_open())
+            csv.close();
+    }
+
+    bool IsCsvOpen() const { return csv.is_open(); }
+
+private:
+    std::vector<std::string> names;
+    std::vector<unsigned int> queries;
+    std::vector<bool> issued;
+    std::vector<float> history, last;
+    std::vector<long long> passSamples; // history entries written per pass
+    int historySize;
+    long long frame = 0, samples = 0;
+    int slot = 0;
+    std::ofstream csv;
+
+    // reads the results of the frame in the current slot, all of which are available
+    void collect()
+    {
+        int passCount = GetPassCount();
+        if (csv.is_open())
+            csv << frame - FRAME_LATENCY;
+        for (int pass = 0; pass < passCount; ++pass)
+        {
+            int index = slot * passCount + pass;
+            if (csv.is_open())
+                csv << ",";
+            if (!issued[index])
+            {
+                last[pass] = 0.0f; // pass was skipped that frame and stays out of its statistics
+                continue;
+            }
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &elapsed);
+            last[pass] = (float)(elapsed / 1.0e6);
+            history[pass * historySize + passSamples[pass] % historySize] = last[pass];
+            ++passSamples[pass];
+            if (csv.is_open())
+                csv << last[pass];
+        }
+        ++samples;
+        if (csv.is_open())
+            csv << "\n";
+    }
+
+    // op 0: min, 1: average, 2: max
+    float reduce(int pass, int op) const
+    {
+        int count = (int)(passSamples[pass] < historySize ? passSamples[pass] : historySize);
+        if (count == 0)
+            return 0.0f;
+        const float* values = &history[pass * historySize];
+        float result = op == 1 ? 0.0f : values[0];
+        for (int i = 0; i < count; ++i)
+        {
+            if (op == 0)
+                result = values[i] < result ? values[i] : result;
+            else if (op == 1)
+                result += values[i];
+            else
+                result = values[i] > result ? values[i] : result;
+        }
+        return op == 1 ? result / count : result;
+    }
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// An offscreen OpenGL context with no window and no swap chain, used by --headless runs on display-less nodes.
+// On Linux this is a surfaceless EGL context (works with Mesa llvmpipe), other platforms report failure.
+class HeadlessContext
+{
+public:
+    ~HeadlessContext()
+    {
+        Destroy();
+    }
+
+    // creates a core profile context of the requested version and makes it current
+    bool Create(int major, int minor)
+    {
+#ifdef __linux__
+        // prefer Mesa's surfaceless platform so no X/Wayland connection is needed
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+        {
+            std::cout << "ERROR::HEADLESS::EGL_INITIALIZE_FAILED" << std::endl;
+            return false;
+        }
+
+        const EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+        {
+            std::cout << "ERROR::HEADLESS::EGL_NO_CONFIG" << std::endl;
+            return false;
+        }
+        eglBindAPI(EGL_OPENGL_API);
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT)
+        {
+            std::cout << "ERROR::HEADLESS::EGL_CREATE_CONTEXT_FAILED" << std::endl;
+            return false;
+        }
+        // no surface at all: everything renders into application framebuffers
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "ERROR::HEADLESS::EGL_MAKE_CURRENT_FAILED" << std::endl;
+            return false;
+        }
+        return true;
+#else
+        std::cout << "ERROR::HEADLESS::NOT_SUPPORTED_ON_THIS_PLATFORM" << std::endl;
+        return false;
+#endif
+    }
+
+    void Destroy()
+    {
+#ifdef __linux__
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+#endif
+    }
+
+    // loader entry point handed to glad
+    static void* GetProcAddress(const char* name)
+    {
+#ifdef __linux__
+        return (void*)eglGetProcAddress(name);
+#else
+        return nullptr;
+#endif
+    }
+
+private:
+#ifdef __linux__
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+#endif
+};
+
+// Reads back the color attachment of the given framebuffer and writes it as a binary PPM (top row first)
+inline bool WriteFramebufferPPM(const std::string& path, unsigned int fbo, int width, int height)
+{
+    std::vector<unsigned char> pixels(width * height * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::HEADLESS::FAILED_TO_WRITE " << path << std::endl;
+        return false;
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+    for (int y = height - 1; y >= 0; --y)
+        file.write((const char*)&pixels[y * width * 3], width * 3);
+    return true;
+}
+
+// Writes single channel values in [0, 1] (bottom row first, as read back from GL) as a binary PGM (top row first)
+inline bool WriteValuesPGM(const std::string& path, const float* values, int width, int height)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::HEADLESS::FAILED_TO_WRITE " << path << std::endl;
+        return false;
+    }
+    file << "P5\n" << width << " " << height << "\n255\n";
+    std::vector<unsigned char> row(width);
+    for (int y = height - 1; y >= 0; --y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            float v = values[y * width + x];
+            v = v < 0.f ? 0.f : (v > 1.f ? 1.f : v);
+            row[x] = (unsigned char)(v * 255.f + 0.5f);
+        }
+        file.write((const char*)&row[0], width);
+    }
+    return true;
+}
+
+// Reads back a single channel float texture (e.g. the AO buffer) and writes it as a binary PGM
+inline bool WriteTexturePGM(const std::string& path, unsigned int texture, int width, int height)
+{
+    std::vector<float> values(width * height);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, &values[0]);
+    return WriteValuesPGM(path, &values[0], width, height);
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// Per-instance vertex attributes of the instanced geometry pass
+struct InstanceData
+{
+    glm::mat4 model;
+    glm::mat3 normalMatrix; // transpose(inverse(mat3(model))), so the shader does not invert per vertex
+};
+
+// A vertex buffer of InstanceData read once per instance, at attribute locations 7-13 (after the bone
+// attributes of Mesh): 7-10 the model matrix columns, 11-13 the normal matrix columns
+class InstanceBuffer
+{
+public:
+    static constexpr unsigned int FirstAttribute = 7;
+
+    unsigned int ID;
+
+    InstanceBuffer()
+    {
+        glGenBuffers(1, &ID);
+    }
+
+    ~InstanceBuffer()
+    {
+        glDeleteBuffers(1, &ID);
+    }
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    // replaces the contents; the buffer keeps its name, so VAOs that point at it stay valid
+    void Update(const std::vector<InstanceData>& instances)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.empty() ? nullptr : &instances[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        count = (int)instances.size();
+    }
+
+    int GetCount() const { return count; }
+
+    // adds the instance attributes to the currently bound VAO
+    void BindAttributes() const
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        for (unsigned int column = 0; column < 4; ++column)
+        {
+            unsigned int location = FirstAttribute + column;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(location, 1);
+        }
+        for (unsigned int column = 0; column < 3; ++column)
+        {
+            unsigned int location = FirstAttribute + 4 + column;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3)));
+            glVertexAttribDivisor(location, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // side x side copies of local, spacing apart on the xz plane and centred on the origin
+    static std::vector<InstanceData> Grid(int side, float spacing, const glm::mat4& local)
+    {
+        std::vector<InstanceData> instances;
+        instances.reserve((size_t)side * side);
+        float first = -0.5f * (side - 1) * spacing;
+        for (int i = 0; i < side; ++i)
+        {
+            for (int j = 0; j < side; ++j)
+            {
+                InstanceData instance;
+                instance.model = glm::translate(glm::mat4(1.0f), glm::vec3(first + i * spacing, 0.0f, first + j * spacing)) * local;
+                instance.normalMatrix = glm::transpose(glm::inverse(glm::mat3(instance.model)));
+                instances.push_back(instance);
+            }
+        }
+        return instances;
+    }
+
+private:
+    int count = 0;
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Shader.h"
+#include "InstanceBuffer.h"
 
 #include <string>
 #include <vector>
@@ -58,16 +59,66 @@ public:
 
     // render the mesh
     void Draw(Shader &shader) 
+    {
+        BindTextures(shader);
+        
+        // draw mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // adds the per-instance attributes of instances to this mesh's VAO; once is enough, the buffer may be refilled
+    void SetInstanceBuffer(const InstanceBuffer &instances)
+    {
+        glBindVertexArray(VAO);
+        instances.BindAttributes();
+        glBindVertexArray(0);
+    }
+
+    // render every instance of the buffer given to SetInstanceBuffer in one draw
+    void DrawInstanced(Shader &shader, int instanceCount)
+    {
+        BindTextures(shader);
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0, instanceCount);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // binds the mesh textures to units 0.. and points the shader's samplers at them
+    void BindTextures(Shader &shader) const
     {
         // bind appropriate textures
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+            // now set the sampler to the correct texture unit (resolved through the shader's uniform cache)
+            shader.setInt(samplerNames[i], i);
+            // and finally bind the texture
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        }
+    }
+
+private:
+    // render data 
+    unsigned int VBO, EBO;
+    // sampler uniform name of each texture, e.g. texture_diffuse1
+    vector<string> samplerNames;
+
+    // builds the sampler names once: the N in texture_diffuseN counts textures of the same type
+    void setupSamplerNames()
+    {
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        samplerNames.clear();
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
             if(name == "texture_diffuse")
@@ -78,29 +129,15 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to string
              else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            samplerNames.push_back(name + number);
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
-
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
+        setupSamplerNames();
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
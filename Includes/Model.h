@@ -45,6 +45,19 @@ public:
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
+
+    // instanced counterparts, see Mesh
+    void SetInstanceBuffer(const InstanceBuffer &instances)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].SetInstanceBuffer(instances);
+    }
+
+    void DrawInstanced(Shader &shader, int instanceCount)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, instanceCount);
+    }
     
 private:
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
@@ -0,0 +1,60 @@
+#ifndef OVERDRAW_COUNTER_H
+#define OVERDRAW_COUNTER_H
+
+#include <glad/glad.h>
+
+// Fragments that pass the depth test in one pass, per pixel, from GL_SAMPLES_PASSED queries. Like GpuTimer, the
+// queries rotate over FRAME_LATENCY frames and a result is only read once GL_QUERY_RESULT_AVAILABLE says so.
+class OverdrawCounter
+{
+public:
+    static constexpr int FRAME_LATENCY = 3;
+
+    OverdrawCounter()
+    {
+        glGenQueries(FRAME_LATENCY, queries);
+    }
+
+    ~OverdrawCounter()
+    {
+        glDeleteQueries(FRAME_LATENCY, queries);
+    }
+
+    OverdrawCounter(const OverdrawCounter&) = delete;
+    OverdrawCounter& operator=(const OverdrawCounter&) = delete;
+
+    // pixels: size of the render target the counted pass covers
+    void Begin(int pixels)
+    {
+        slot = (slot + 1) % FRAME_LATENCY;
+        if (issuedPixels[slot] > 0)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint samples = 0;
+                glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT, &samples);
+                overdraw = (float)samples / (float)issuedPixels[slot];
+            }
+        }
+        issuedPixels[slot] = pixels;
+        glBeginQuery(GL_SAMPLES_PASSED, queries[slot]);
+    }
+
+    void End()
+    {
+        glEndQuery(GL_SAMPLES_PASSED);
+    }
+
+    // fragments that passed the depth test per pixel in the most recent frame with a result; 0 before the first
+    float GetOverdraw() const { return overdraw; }
+
+private:
+    GLuint queries[FRAME_LATENCY];
+    int issuedPixels[FRAME_LATENCY] = {};
+    int slot = 0;
+    float overdraw = 0.0f;
+};
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// glGetProgramBinary / glProgramBinary (GL 4.1 / ARB_get_program_binary)
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// On-disk cache of linked programs, one file per program named after its key. The key hashes the final stage
+// sources (so the injected defines and expanded includes are part of it) together with the driver's vendor,
+// renderer and version strings, so editing a shader or updating the driver simply misses. A binary the driver
+// still rejects is deleted and the program is compiled from source again.
+class ProgramCache
+{
+public:
+    typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+    typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+    typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+    // true when the context can save and restore program binaries; the cache stays disabled otherwise
+    bool Load(GLADloadproc load, const std::string& cacheDirectory)
+    {
+        if (!HasGLVersionOrExtension(4, 1, "GL_ARB_get_program_binary"))
+            return false;
+        // some drivers expose the entry points but no binary format
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        getProgramBinary = (GetProgramBinaryProc)load("glGetProgramBinary");
+        programBinary = (ProgramBinaryProc)load("glProgramBinary");
+        programParameteri = (ProgramParameteriProc)load("glProgramParameteri");
+        if (formatCount <= 0 || !getProgramBinary || !programBinary || !programParameteri)
+            return false;
+        directory = cacheDirectory;
+        driver = std::string((const char*)glGetString(GL_VENDOR)) + "\n" + (const char*)glGetString(GL_RENDERER) + "\n" +
+                 (const char*)glGetString(GL_VERSION);
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        enabled = !error;
+        return enabled;
+    }
+
+    bool IsEnabled() const { return enabled; }
+
+    // deletes every cached binary, so the next launch starts cold
+    void Clear()
+    {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+        {
+            if (entry.path().extension() == ".bin")
+                std::filesystem::remove(entry.path(), error);
+        }
+    }
+
+    uint64_t Key(const std::vector<const std::string*>& sources) const
+    {
+        // FNV-1a, with a separator after each part so moving text between stages changes the key
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const std::string& text)
+        {
+            for (unsigned char c : text)
+            {
+                hash ^= c;
+                hash *= 1099511628211ull;
+            }
+            hash ^= 0xFF;
+            hash *= 1099511628211ull;
+        };
+        mix(driver);
+        for (const std::string* source : sources)
+            mix(*source);
+        return hash;
+    }
+
+    // a linked program restored from the cache, or 0 when there is no usable binary for the key
+    GLuint Restore(uint64_t key)
+    {
+        if (!enabled)
+            return 0;
+        std::ifstream file(path(key), std::ios::binary);
+        if (!file)
+        {
+            ++misses;
+            return 0;
+        }
+        FileHeader header;
+        std::vector<char> binary;
+        if (file.read((char*)&header, sizeof(header)) && header.magic == Magic && header.key == key && header.length > 0)
+        {
+            binary.resize(header.length);
+            file.read(binary.data(), header.length);
+        }
+        file.close();
+        if (binary.empty() || !file)
+        {
+            std::cout << "ERROR::PROGRAM_CACHE::CORRUPT_ENTRY " << path(key) << std::endl;
+            discard(key);
+            return 0;
+        }
+        GLuint program = glCreateProgram();
+        programBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            // the driver no longer accepts it (e.g. a different build with the same version string)
+            glDeleteProgram(program);
+            discard(key);
+            return 0;
+        }
+        ++hits;
+        return program;
+    }
+
+    // call before linking a program that is going to be stored
+    void PrepareLink(GLuint program) const
+    {
+        if (enabled)
+            programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // writes a successfully linked program under key
+    void Store(GLuint program, uint64_t key)
+    {
+        if (!enabled)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        FileHeader header;
+        header.key = key;
+        getProgramBinary(program, length, &length, &header.format, binary.data());
+        header.length = (uint32_t)length;
+        std::ofstream file(path(key), std::ios::binary | std::ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), length);
+        if (!file)
+            std::cout << "ERROR::PROGRAM_CACHE::WRITE_FAILED " << path(key) << std::endl;
+        else
+            ++stores;
+    }
+
+    int GetHits() const { return hits; }
+    // programs that had to be compiled: no entry, or one that was rejected
+    int GetMisses() const { return misses; }
+    int GetStores() const { return stores; }
+
+private:
+    static constexpr uint32_t Magic = 0x42505353; // "SSPB"
+
+    struct FileHeader
+    {
+        uint32_t magic = Magic;
+        GLenum format = GL_NONE;
+        uint64_t key = 0;
+        uint32_t length = 0;
+        uint32_t padding = 0;
+    };
+
+    GetProgramBinaryProc getProgramBinary = nullptr;
+    ProgramBinaryProc programBinary = nullptr;
+    ProgramParameteriProc programParameteri = nullptr;
+    std::string directory;
+    std::string driver;
+    bool enabled = false;
+    int hits = 0, misses = 0, stores = 0;
+
+    std::string path(uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    void discard(uint64_t key)
+    {
+        std::error_code error;
+        std::filesystem::remove(path(key), error);
+        ++misses;
+    }
+};
+
+#endif
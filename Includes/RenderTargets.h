@@ -0,0 +1,335 @@
+#ifndef RENDER_TARGETS_H
+#define RENDER_TARGETS_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+
+#include <iostream>
+#include <vector>
+
+// glTexStorage (GL 4.2 / ARB_texture_storage). Without it textures fall back to mutable glTexImage storage.
+struct GLTextureStorage
+{
+    typedef void (APIENTRYP TexStorage2DProc)(GLenum target, GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height);
+    typedef void (APIENTRYP TexStorage3DProc)(GLenum target, GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height,
+                                              GLsizei depth);
+
+    TexStorage2DProc texStorage2D = nullptr;
+    TexStorage3DProc texStorage3D = nullptr;
+
+    bool Load(GLADloadproc load)
+    {
+        if (!HasGLVersionOrExtension(4, 2, "GL_ARB_texture_storage"))
+            return false;
+        texStorage2D = (TexStorage2DProc)load("glTexStorage2D");
+        texStorage3D = (TexStorage3DProc)load("glTexStorage3D");
+        return texStorage2D && texStorage3D;
+    }
+};
+
+// Everything that has to match for a pooled texture to be handed out again
+struct TextureDesc
+{
+    GLenum target = GL_TEXTURE_2D;   // GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+    GLenum internalFormat = GL_NONE; // GL_NONE: no storage wanted
+    int width = 0, height = 0, layers = 1, levels = 1;
+    GLenum filter = GL_NEAREST;      // min filter; the mag filter is its non-mipmapped counterpart
+    GLenum wrap = GL_REPEAT;
+
+    static TextureDesc Texture2D(GLenum internalFormat, int width, int height, GLenum wrap = GL_REPEAT, GLenum filter = GL_NEAREST,
+                                 int levels = 1)
+    {
+        TextureDesc desc;
+        desc.internalFormat = internalFormat;
+        desc.width = width;
+        desc.height = height;
+        desc.levels = levels;
+        desc.filter = filter;
+        desc.wrap = wrap;
+        return desc;
+    }
+
+    static TextureDesc Array(GLenum internalFormat, int width, int height, int layers)
+    {
+        TextureDesc desc = Texture2D(internalFormat, width, height);
+        desc.target = GL_TEXTURE_2D_ARRAY;
+        desc.layers = layers;
+        return desc;
+    }
+
+    bool operator==(const TextureDesc& other) const
+    {
+        return target == other.target && internalFormat == other.internalFormat && width == other.width && height == other.height
+            && layers == other.layers && levels == other.levels && filter == other.filter && wrap == other.wrap;
+    }
+    bool operator!=(const TextureDesc& other) const { return !(*this == other); }
+};
+
+// Textures whose owner let go of them, kept for the next request with the same description. Entries nobody
+// asked for within IdleFrames frames are deleted, so dragging a window edge does not hoard every size it passed.
+class TexturePool
+{
+public:
+    static constexpr long long IdleFrames = 120;
+
+    explicit TexturePool(const GLTextureStorage& storage) : storage(storage) {}
+
+    ~TexturePool()
+    {
+        for (const Entry& entry : entries)
+            glDeleteTextures(1, &entry.texture);
+    }
+
+    TexturePool(const TexturePool&) = delete;
+    TexturePool& operator=(const TexturePool&) = delete;
+
+    unsigned int Acquire(const TextureDesc& desc)
+    {
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            if (entries[i].desc != desc)
+                continue;
+            unsigned int texture = entries[i].texture;
+            entries.erase(entries.begin() + i);
+            ++reuseCount;
+            return texture;
+        }
+        ++allocationCount;
+        return create(desc);
+    }
+
+    void Release(unsigned int texture, const TextureDesc& desc, long long frame)
+    {
+        entries.push_back({ desc, texture, frame });
+    }
+
+    void Collect(long long frame)
+    {
+        for (size_t i = 0; i < entries.size();)
+        {
+            if (frame - entries[i].releasedFrame <= IdleFrames)
+            {
+                ++i;
+                continue;
+            }
+            glDeleteTextures(1, &entries[i].texture);
+            entries.erase(entries.begin() + i);
+        }
+    }
+
+    bool IsImmutable() const { return storage.texStorage2D != nullptr; }
+    int GetFreeCount() const { return (int)entries.size(); }
+    int GetAllocationCount() const { return allocationCount; }
+    int GetReuseCount() const { return reuseCount; }
+
+private:
+    struct Entry
+    {
+        TextureDesc desc;
+        unsigned int texture;
+        long long releasedFrame;
+    };
+    const GLTextureStorage& storage;
+    std::vector<Entry> entries;
+    int allocationCount = 0, reuseCount = 0;
+
+    // client format and type for the mutable fallback; no data is uploaded, they only have to be legal
+    static void transferFormat(GLenum internalFormat, GLenum& format, GLenum& type)
+    {
+        type = GL_FLOAT;
+        switch (internalFormat)
+        {
+        case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F: format = GL_DEPTH_COMPONENT; break;
+        case GL_R8: case GL_R16F: case GL_R32F: format = GL_RED; break;
+        case GL_RG8: case GL_RG16: case GL_RG16F: format = GL_RG; break;
+        case GL_RGB16F: format = GL_RGB; break;
+        case GL_RGBA8: format = GL_RGBA; type = GL_UNSIGNED_BYTE; break;
+        default: format = GL_RGBA; break;
+        }
+    }
+
+    unsigned int create(const TextureDesc& desc)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(desc.target, texture);
+        if (storage.texStorage2D)
+        {
+            if (desc.target == GL_TEXTURE_2D_ARRAY)
+                storage.texStorage3D(desc.target, desc.levels, desc.internalFormat, desc.width, desc.height, desc.layers);
+            else
+                storage.texStorage2D(desc.target, desc.levels, desc.internalFormat, desc.width, desc.height);
+        }
+        else
+        {
+            GLenum format, type;
+            transferFormat(desc.internalFormat, format, type);
+            for (int level = 0; level < desc.levels; ++level)
+            {
+                int width = desc.width >> level > 1 ? desc.width >> level : 1;
+                int height = desc.height >> level > 1 ? desc.height >> level : 1;
+                if (desc.target == GL_TEXTURE_2D_ARRAY)
+                    glTexImage3D(desc.target, level, desc.internalFormat, width, height, desc.layers, 0, format, type, nullptr);
+                else
+                    glTexImage2D(desc.target, level, desc.internalFormat, width, height, 0, format, type, nullptr);
+            }
+            glTexParameteri(desc.target, GL_TEXTURE_MAX_LEVEL, desc.levels - 1);
+        }
+        glTexParameteri(desc.target, GL_TEXTURE_MIN_FILTER, desc.filter);
+        glTexParameteri(desc.target, GL_TEXTURE_MAG_FILTER, desc.filter == GL_LINEAR || desc.filter == GL_LINEAR_MIPMAP_NEAREST
+            || desc.filter == GL_LINEAR_MIPMAP_LINEAR ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(desc.target, GL_TEXTURE_WRAP_S, desc.wrap);
+        glTexParameteri(desc.target, GL_TEXTURE_WRAP_T, desc.wrap);
+        return texture;
+    }
+};
+
+// One texture attached to a framebuffer at an attachment point
+struct FramebufferAttachment
+{
+    GLenum point;
+    int target;
+};
+
+// Owns every render target texture and framebuffer of the renderer. Callers describe what each target should
+// look like every frame; Update() swaps out only the targets whose description changed (freed storage goes to
+// the pool) and re-attaches the framebuffers that use them. Target and framebuffer ids are the caller's enums.
+class RenderTargets
+{
+public:
+    RenderTargets(const GLTextureStorage& storage, int targetCount, int framebufferCount)
+        : pool(storage), targets(targetCount), framebuffers(framebufferCount)
+    {
+        for (FramebufferEntry& framebuffer : framebuffers)
+            glGenFramebuffers(1, &framebuffer.id);
+    }
+
+    ~RenderTargets()
+    {
+        for (FramebufferEntry& framebuffer : framebuffers)
+            glDeleteFramebuffers(1, &framebuffer.id);
+        for (Target& target : targets)
+        {
+            if (target.texture)
+                glDeleteTextures(1, &target.texture);
+        }
+    }
+
+    RenderTargets(const RenderTargets&) = delete;
+    RenderTargets& operator=(const RenderTargets&) = delete;
+
+    // the attachments Update() maintains; framebuffers whose attachments change per draw declare none
+    void SetAttachments(int framebuffer, const std::vector<FramebufferAttachment>& attachments)
+    {
+        framebuffers[framebuffer].attachments = attachments;
+        framebuffers[framebuffer].dirty = true;
+    }
+
+    void Describe(int target, const TextureDesc& desc)
+    {
+        targets[target].wanted = desc;
+    }
+
+    // Reallocates changed targets and re-attaches their framebuffers; returns whether anything changed
+    bool Update(long long frame)
+    {
+        bool anyChanged = false;
+        for (Target& target : targets)
+        {
+            target.changed = target.wanted != target.desc;
+            if (!target.changed)
+                continue;
+            if (target.texture)
+                pool.Release(target.texture, target.desc, frame);
+            target.texture = target.wanted.internalFormat != GL_NONE ? pool.Acquire(target.wanted) : 0;
+            target.desc = target.wanted;
+            anyChanged = true;
+        }
+        for (FramebufferEntry& framebuffer : framebuffers)
+        {
+            for (const FramebufferAttachment& attachment : framebuffer.attachments)
+                framebuffer.dirty = framebuffer.dirty || targets[attachment.target].changed;
+            if (framebuffer.dirty)
+                attach(framebuffer);
+        }
+        pool.Collect(frame);
+        return anyChanged;
+    }
+
+    unsigned int Get(int target) const { return targets[target].texture; }
+    const TextureDesc& GetDesc(int target) const { return targets[target].desc; }
+    // whether the last Update() gave the target new storage
+    bool Changed(int target) const { return targets[target].changed; }
+    unsigned int Framebuffer(int framebuffer) const { return framebuffers[framebuffer].id; }
+    const TexturePool& GetPool() const { return pool; }
+
+    // bytes of storage held by the live targets (pooled textures excluded)
+    size_t GetLiveBytes() const
+    {
+        size_t bytes = 0;
+        for (const Target& target : targets)
+        {
+            const TextureDesc& desc = target.desc;
+            if (desc.internalFormat == GL_NONE)
+                continue;
+            size_t levelBytes = (size_t)desc.width * desc.height * desc.layers * bytesPerTexel(desc.internalFormat);
+            bytes += desc.levels > 1 ? levelBytes * 4 / 3 : levelBytes;
+        }
+        return bytes;
+    }
+
+private:
+    struct Target
+    {
+        TextureDesc wanted, desc;
+        unsigned int texture = 0;
+        bool changed = false;
+    };
+    struct FramebufferEntry
+    {
+        unsigned int id = 0;
+        std::vector<FramebufferAttachment> attachments;
+        bool dirty = false;
+    };
+    TexturePool pool;
+    std::vector<Target> targets;
+    std::vector<FramebufferEntry> framebuffers;
+
+    static int bytesPerTexel(GLenum internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_R8: return 1;
+        case GL_RG8: case GL_R16F: return 2;
+        case GL_RGB16F: return 6;
+        case GL_RGBA16F: return 8;
+        default: return 4; // RG16, RGBA8, R32F, 24/32-bit depth
+        }
+    }
+
+    void attach(FramebufferEntry& framebuffer)
+    {
+        framebuffer.dirty = false;
+        if (framebuffer.attachments.empty())
+            return;
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id);
+        std::vector<GLenum> drawBuffers;
+        bool complete = true;
+        for (const FramebufferAttachment& attachment : framebuffer.attachments)
+        {
+            unsigned int texture = targets[attachment.target].texture;
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment.point, GL_TEXTURE_2D, texture, 0);
+            if (attachment.point != GL_DEPTH_ATTACHMENT)
+                drawBuffers.push_back(attachment.point);
+            complete = complete && texture != 0;
+        }
+        glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+        // framebuffers of targets that are switched off are left incomplete on purpose
+        if (complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::RENDER_TARGETS::FRAMEBUFFER_NOT_COMPLETE " << framebuffer.id << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+
+#endif
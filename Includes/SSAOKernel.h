@@ -0,0 +1,230 @@
+#ifndef SSAO_KERNEL_H
+#define SSAO_KERNEL_H
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <random>
+#include <vector>
+
+// Sample kernels for the SSAO pass. Every set except the legacy random one is a hemisphere around +z (the normal
+// after the TBN transform); sample lengths follow lerp(0.1, 1, t^2) for a uniform t, so taps crowd the centre.
+enum KernelDistribution
+{
+    KERNEL_RANDOM = 0,     // the original uniform_real_distribution sphere, kept for comparison
+    KERNEL_HALTON = 1,     // Halton bases 2, 3 (direction) and 5 (length)
+    KERNEL_HAMMERSLEY = 2, // i / N (length) with bases 2 and 3 (direction)
+    KERNEL_POISSON = 3,    // best-candidate Poisson-disk points in the half ball
+    KERNEL_FIBONACCI = 4,  // spherical Fibonacci directions, base 2 length
+    KERNEL_DISTRIBUTION_COUNT
+};
+
+inline const char* GetKernelDistributionName(int distribution)
+{
+    static const char* names[KERNEL_DISTRIBUTION_COUNT] = { "Random", "Halton", "Hammersley", "Poisson", "Fibonacci" };
+    return names[distribution];
+}
+
+// only the legacy random set samples the whole sphere; the shaders treat the two shapes differently
+inline bool IsHemisphereKernel(int distribution)
+{
+    return distribution != KERNEL_RANDOM;
+}
+
+struct KernelSample
+{
+    float x, y, z;
+};
+
+namespace SSAOKernelDetail
+{
+    constexpr double Pi = 3.14159265358979323846;
+    constexpr double GoldenRatio = 1.61803398874989484820;
+
+    constexpr double RadicalInverse(unsigned int i, unsigned int base)
+    {
+        double result = 0.0, digit = 1.0 / base;
+        for (; i > 0; i /= base, digit /= base)
+            result += digit * (i % base);
+        return result;
+    }
+
+    constexpr double Sqrt(double x)
+    {
+        if (x <= 0.0)
+            return 0.0;
+        double r = x > 1.0 ? x : 1.0;
+        for (int i = 0; i < 64; ++i)
+            r = 0.5 * (r + x / r);
+        return r;
+    }
+
+    // Taylor series after reducing to [-pi, pi]; good to float precision, which is all the tables keep
+    constexpr double Sin(double x)
+    {
+        x -= 2.0 * Pi * (double)(long long)(x / (2.0 * Pi));
+        if (x > Pi)
+            x -= 2.0 * Pi;
+        else if (x < -Pi)
+            x += 2.0 * Pi;
+        double term = x, sum = x;
+        for (int n = 1; n < 16; ++n)
+        {
+            term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr double Cos(double x)
+    {
+        return Sin(x + 0.5 * Pi);
+    }
+
+    constexpr double Fract(double x)
+    {
+        return x - (double)(long long)x;
+    }
+
+    // direction (z = cos theta uniform in [0, 1), phi in [0, 1) turns) scaled to the length for parameter t
+    constexpr KernelSample HemisphereSample(double cosTheta, double phi, double t)
+    {
+        double sinTheta = Sqrt(1.0 - cosTheta * cosTheta);
+        double length = 0.1 + 0.9 * t * t;
+        return { (float)(Cos(2.0 * Pi * phi) * sinTheta * length), (float)(Sin(2.0 * Pi * phi) * sinTheta * length),
+                 (float)(cosTheta * length) };
+    }
+
+    constexpr KernelSample LowDiscrepancySample(int distribution, int i, int size)
+    {
+        switch (distribution)
+        {
+        case KERNEL_HALTON:
+            // index 0 is the origin in every base
+            return HemisphereSample(RadicalInverse(i + 1, 2), RadicalInverse(i + 1, 3), RadicalInverse(i + 1, 5));
+        case KERNEL_HAMMERSLEY:
+            return HemisphereSample(RadicalInverse(i, 2), RadicalInverse(i, 3), (i + 0.5) / size);
+        default: // KERNEL_FIBONACCI
+            return HemisphereSample(1.0 - (i + 0.5) / size, Fract(i / GoldenRatio), RadicalInverse(i, 2));
+        }
+    }
+}
+
+// Kernel of N samples of a low-discrepancy distribution (Halton, Hammersley or Fibonacci), built at compile time
+template <int Distribution, int N>
+constexpr std::array<KernelSample, N> MakeKernel()
+{
+    std::array<KernelSample, N> kernel{};
+    for (int i = 0; i < N; ++i)
+        kernel[i] = SSAOKernelDetail::LowDiscrepancySample(Distribution, i, N);
+    return kernel;
+}
+
+namespace SSAOKernelDetail
+{
+    // Precomputed tables for the common kernel sizes; other sizes run the same code at runtime
+    template <int Distribution>
+    struct KernelTables
+    {
+        static constexpr std::array<KernelSample, 16> kernel16 = MakeKernel<Distribution, 16>();
+        static constexpr std::array<KernelSample, 32> kernel32 = MakeKernel<Distribution, 32>();
+        static constexpr std::array<KernelSample, 64> kernel64 = MakeKernel<Distribution, 64>();
+        static constexpr std::array<KernelSample, 128> kernel128 = MakeKernel<Distribution, 128>();
+
+        static const KernelSample* Find(int size)
+        {
+            switch (size)
+            {
+            case 16: return kernel16.data();
+            case 32: return kernel32.data();
+            case 64: return kernel64.data();
+            case 128: return kernel128.data();
+            default: return nullptr;
+            }
+        }
+    };
+
+    inline const KernelSample* FindTable(int distribution, int size)
+    {
+        switch (distribution)
+        {
+        case KERNEL_HALTON: return KernelTables<KERNEL_HALTON>::Find(size);
+        case KERNEL_HAMMERSLEY: return KernelTables<KERNEL_HAMMERSLEY>::Find(size);
+        case KERNEL_FIBONACCI: return KernelTables<KERNEL_FIBONACCI>::Find(size);
+        default: return nullptr;
+        }
+    }
+
+    // Mitchell's best candidate: each point is the farthest of a growing number of uniform candidates from the
+    // points so far, which approximates a Poisson-disk set of exactly size points. Fixed seed, so reproducible.
+    inline void PoissonKernel(int size, std::vector<glm::vec3>& kernel)
+    {
+        std::mt19937 engine(1234u);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<glm::vec3> points;
+        while ((int)points.size() < size)
+        {
+            glm::vec3 best(0.0f);
+            float bestDistance = -1.0f;
+            int candidates = 8 * ((int)points.size() + 1);
+            for (int c = 0; c < candidates; ++c)
+            {
+                // uniform in the half ball
+                glm::vec3 candidate;
+                do
+                    candidate = glm::vec3(unit(engine) * 2.0f - 1.0f, unit(engine) * 2.0f - 1.0f, unit(engine));
+                while (glm::dot(candidate, candidate) > 1.0f);
+                float nearest = 1e9f;
+                for (const glm::vec3& p : points)
+                    nearest = glm::min(nearest, glm::dot(candidate - p, candidate - p));
+                if (nearest > bestDistance)
+                {
+                    bestDistance = nearest;
+                    best = candidate;
+                }
+            }
+            points.push_back(best);
+        }
+        // |p|^3 is uniform for points uniform in the ball: map it through the common length law
+        kernel.resize(size);
+        for (int i = 0; i < size; ++i)
+        {
+            float length = glm::length(points[i]);
+            float t = length * length * length;
+            kernel[i] = length > 0.0f ? points[i] / length * (0.1f + 0.9f * t * t) : glm::vec3(0.0f, 0.0f, 0.1f);
+        }
+    }
+
+    // The original kernel: random sphere directions and lengths, scaled up with the index
+    inline void RandomKernel(int size, std::vector<glm::vec3>& kernel)
+    {
+        std::default_random_engine engine;
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        kernel.resize(size);
+        for (int i = 0; i < size; ++i)
+        {
+            glm::vec3 sample = glm::normalize(glm::vec3(unit(engine) * 2.0f - 1.0f, unit(engine) * 2.0f - 1.0f, unit(engine) * 2.0f - 1.0f));
+            sample *= unit(engine);
+            float scale = (float)i / (float)size;
+            kernel[i] = sample * (0.1f + 0.9f * scale * scale);
+        }
+    }
+}
+
+// Fills kernel with size samples of the distribution
+inline void GenerateSSAOKernel(int distribution, int size, std::vector<glm::vec3>& kernel)
+{
+    if (distribution == KERNEL_RANDOM)
+        return SSAOKernelDetail::RandomKernel(size, kernel);
+    if (distribution == KERNEL_POISSON)
+        return SSAOKernelDetail::PoissonKernel(size, kernel);
+    kernel.resize(size);
+    const KernelSample* table = SSAOKernelDetail::FindTable(distribution, size);
+    for (int i = 0; i < size; ++i)
+    {
+        KernelSample sample = table ? table[i] : SSAOKernelDetail::LowDiscrepancySample(distribution, i, size);
+        kernel[i] = glm::vec3(sample.x, sample.y, sample.z);
+    }
+}
+
+#endif
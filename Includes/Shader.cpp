@@ -1,4 +1,7 @@
 #include "Shader.h"
+#include "GLCompute.h"
+#include "GLExtensions.h"
+#include "ProgramCache.h"
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -6,100 +9,401 @@
 #include <iostream>
 #include <sstream>
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace
 {
-	std::string vertexCode, fragmentCode;
-	std::ifstream vShaderFile, fShaderFile;
-	vShaderFile.exceptions(std::ifstream::badbit | std::ifstream::failbit);
-	fShaderFile.exceptions(std::ifstream::badbit | std::ifstream::failbit);
+	// GL_KHR_parallel_shader_compile (or its ARB predecessor); neither is core in any version
+	typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+	bool parallelCompile = false;
+
+	// uniform lookups that missed the link-time table, over every Shader
+	unsigned int totalUniformCacheMisses = 0;
 
-	try
+	const char* stageName(GLenum type)
 	{
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		std::stringstream vShaderStream, fShaderStream;
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-		vShaderFile.close();
-		fShaderFile.close();
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
+		return type == GL_VERTEX_SHADER ? "VERTEX" : type == GL_FRAGMENT_SHADER ? "FRAGMENT" : "COMPUTE";
 	}
-	catch(std::ifstream::failure e)
+
+	// FNV-1a
+	unsigned int hashUniformName(const char* name, size_t length)
 	{
-		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+		unsigned int hash = 2166136261u;
+		for (size_t i = 0; i < length; ++i)
+		{
+			hash ^= (unsigned char)name[i];
+			hash *= 16777619u;
+		}
+		return hash;
 	}
-	const char* vShaderCode = vertexCode.c_str();
-	const char* fShaderCode = fragmentCode.c_str();
 
-	unsigned int vertex, fragment;
-	int success;
-	char infoLog[512];
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, nullptr);
-	glCompileShader(vertex);
-	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-	if (!success)
+	constexpr int MAX_INCLUDE_DEPTH = 8;
+
+	bool readShaderFile(const std::string& path, std::string& text)
 	{
-		glGetShaderInfoLog(vertex, 512, nullptr, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+		std::ifstream file;
+		file.exceptions(std::ifstream::badbit | std::ifstream::failbit);
+		try
+		{
+			file.open(path);
+			std::stringstream stream;
+			stream << file.rdbuf();
+			file.close();
+			text = stream.str();
+			return true;
+		}
+		catch(std::ifstream::failure& e)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+			return false;
+		}
 	}
 
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, nullptr);
-	glCompileShader(fragment);
-	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-	if (!success)
+	// Copies text (starting at firstLine of its file) to out with every #include "file" replaced by that file,
+	// resolved next to the including one and bracketed by #line directives so compiler messages name the right
+	// source string and line. Source string 0 is the stage file, includes count up in the order they are reached.
+	void expandIncludes(const std::string& path, const std::string& text, int firstLine, int sourceIndex, int depth, int& sourceCount,
+		std::string& out)
 	{
-		glGetShaderInfoLog(fragment, 512, nullptr, infoLog);
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+		std::string directory = path.substr(0, path.find_last_of("\\/") + 1);
+		std::istringstream lines(text);
+		std::string line;
+		int lineNumber = firstLine - 1;
+		while (std::getline(lines, line))
+		{
+			++lineNumber;
+			size_t start = line.find_first_not_of(" \t");
+			if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+			{
+				out += line;
+				out += '\n';
+				continue;
+			}
+			size_t open = line.find('"', start), close = open == std::string::npos ? open : line.find('"', open + 1);
+			if (close == std::string::npos)
+			{
+				std::cout << "ERROR::SHADER::MALFORMED_INCLUDE " << path << ":" << lineNumber << std::endl;
+				continue;
+			}
+			std::string includePath = directory + line.substr(open + 1, close - open - 1);
+			std::string includeText;
+			if (depth >= MAX_INCLUDE_DEPTH)
+			{
+				std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP " << includePath << std::endl;
+				continue;
+			}
+			if (!readShaderFile(includePath, includeText))
+				continue;
+			int includeIndex = ++sourceCount;
+			out += "#line 1 " + std::to_string(includeIndex) + "\n";
+			expandIncludes(includePath, includeText, 1, includeIndex, depth + 1, sourceCount, out);
+			out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceIndex) + "\n";
+		}
 	}
 
+	// Source of a shader stage: the file with its includes expanded and the defines placed right after #version
+	std::string loadShaderSource(const std::string& path, const std::vector<ShaderDefine>& defines)
+	{
+		std::string text, source;
+		if (!readShaderFile(path, text))
+			return source;
+		size_t version = text.find("#version");
+		size_t bodyStart = 0;
+		int bodyLine = 1;
+		if (version != std::string::npos)
+		{
+			bodyStart = text.find('\n', version);
+			bodyStart = bodyStart == std::string::npos ? text.size() : bodyStart + 1;
+			for (size_t i = 0; i < bodyStart; ++i)
+				bodyLine += text[i] == '\n';
+			source = text.substr(0, bodyStart);
+		}
+		for (const ShaderDefine& define : defines)
+			source += "#define " + define.name + " " + define.value + "\n";
+		source += "#line " + std::to_string(bodyLine) + " 0\n";
+		int sourceCount = 0;
+		expandIncludes(path, text.substr(bodyStart), bodyLine, 0, 0, sourceCount, source);
+		return source;
+	}
+}
+
+ProgramCache* Shader::programCache = nullptr;
+
+Shader::Shader(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<ShaderDefine>& defines)
+{
+	std::string vertexCode = loadShaderSource(vertexPath, defines);
+	std::string fragmentCode = loadShaderSource(fragmentPath, defines);
+	cacheKey = programCache ? programCache->Key({ &vertexCode, &fragmentCode }) : 0;
+	ID = programCache ? programCache->Restore(cacheKey) : 0;
+	if (ID)
+	{
+		linked = true;
+		cacheActiveUniforms();
+		return;
+	}
 	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
+	submitStage(GL_VERTEX_SHADER, vertexCode);
+	submitStage(GL_FRAGMENT_SHADER, fragmentCode);
+	submitLink();
+}
+
+Shader::Shader(const std::string& computePath, const std::vector<ShaderDefine>& defines)
+{
+	std::string computeCode = loadShaderSource(computePath, defines);
+	cacheKey = programCache ? programCache->Key({ &computeCode }) : 0;
+	ID = programCache ? programCache->Restore(cacheKey) : 0;
+	if (ID)
+	{
+		linked = true;
+		cacheActiveUniforms();
+		return;
+	}
+	ID = glCreateProgram();
+	submitStage(GL_COMPUTE_SHADER, computeCode);
+	submitLink();
+}
+
+bool Shader::enableParallelCompile(GLADloadproc load)
+{
+	parallelCompile = false;
+	const char* entryPoint = HasGLExtension("GL_KHR_parallel_shader_compile") ? "glMaxShaderCompilerThreadsKHR"
+		: HasGLExtension("GL_ARB_parallel_shader_compile") ? "glMaxShaderCompilerThreadsARB" : nullptr;
+	MaxShaderCompilerThreadsProc maxShaderCompilerThreads = entryPoint ? (MaxShaderCompilerThreadsProc)load(entryPoint) : nullptr;
+	if (!maxShaderCompilerThreads)
+		return false;
+	maxShaderCompilerThreads(0xFFFFFFFFu); // as many threads as the driver likes
+	parallelCompile = true;
+	return true;
+}
+
+bool Shader::isParallelCompile()
+{
+	return parallelCompile;
+}
+
+void Shader::submitStage(GLenum type, const std::string& source)
+{
+	const char* code = source.c_str();
+	unsigned int stage = glCreateShader(type);
+	glShaderSource(stage, 1, &code, nullptr);
+	glCompileShader(stage);
+	glAttachShader(ID, stage);
+	stages[stageCount++] = stage;
+}
+
+void Shader::submitLink()
+{
+	if (programCache)
+		programCache->PrepareLink(ID);
 	glLinkProgram(ID);
+	pending = true;
+}
+
+bool Shader::isReady() const
+{
+	if (!pending || !parallelCompile)
+		return true;
+	int done = 0;
+	glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+	return done != 0;
+}
+
+void Shader::finish() const
+{
+	if (!pending)
+		return;
+	pending = false;
+	int success;
+	char infoLog[512];
+	for (int i = 0; i < stageCount; ++i)
+	{
+		glGetShaderiv(stages[i], GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			int type = 0;
+			glGetShaderiv(stages[i], GL_SHADER_TYPE, &type);
+			glGetShaderInfoLog(stages[i], 512, nullptr, infoLog);
+			std::cout << "ERROR::SHADER::" << stageName((GLenum)type) << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+		}
+	}
 	glGetProgramiv(ID, GL_LINK_STATUS, &success);
+	linked = success != 0;
 	if (!success)
 	{
 		glGetProgramInfoLog(ID, 512, nullptr, infoLog);
 		std::cout << "ERROR::PROGRAM::LINK_FAILED\n" << infoLog << std::endl;
 	}
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
+	else if (programCache)
+	{
+		programCache->Store(ID, cacheKey);
+	}
+	for (int i = 0; i < stageCount; ++i)
+		glDeleteShader(stages[i]);
+	stageCount = 0;
+	cacheActiveUniforms();
 }
 
 void Shader::use()
 {
+	finish();
 	glUseProgram(ID);
 }
 
 void Shader::set1b(const std::string& name, bool value) const
 {
-	int uniformLocation = glGetUniformLocation(ID, name.c_str());
+	int uniformLocation = getUniformLocation(name);
 	glUniform1i(uniformLocation, (int)value);
 }
 
 void Shader::set1i(const std::string& name, int value) const
 {
-	int uniformLocation = glGetUniformLocation(ID, name.c_str());
+	int uniformLocation = getUniformLocation(name);
 	glUniform1i(uniformLocation, value);
 }
 
 void Shader::set1f(const std::string& name, float value) const
 {
-	int uniformLocation = glGetUniformLocation(ID, name.c_str());
+	int uniformLocation = getUniformLocation(name);
 	glUniform1f(uniformLocation, value);
 }
 
+void Shader::set2i(const std::string& name, int value1, int value2) const
+{
+	int uniformLocation = getUniformLocation(name);
+	glUniform2i(uniformLocation, value1, value2);
+}
+
 void Shader::set4f(const std::string& name, float value1, float value2, float value3, float value4) const
 {
-	int uniformLocation = glGetUniformLocation(ID, name.c_str());
+	int uniformLocation = getUniformLocation(name);
 	glUniform4f(uniformLocation, value1, value2, value3, value4);
 }
 
 void Shader::set2fv(const std::string& name, int count, float* valueArr) const
 {
-	int uniformLocation = glGetUniformLocation(ID, name.c_str());
+	int uniformLocation = getUniformLocation(name);
 	glUniform2fv(uniformLocation, count, valueArr);
 }
+
+void Shader::bindUniformBlock(const std::string& name, unsigned int binding) const
+{
+	finish();
+	unsigned int blockIndex = glGetUniformBlockIndex(ID, name.c_str());
+	if (blockIndex != GL_INVALID_INDEX)
+		glUniformBlockBinding(ID, blockIndex, binding);
+}
+
+unsigned int Shader::getTotalUniformCacheMisses()
+{
+	return totalUniformCacheMisses;
+}
+
+int Shader::getUniformLocation(const std::string& name) const
+{
+	finish();
+	const UniformSlot* slot = findUniform(name, hashUniformName(name.c_str(), name.size()));
+	if (slot)
+		return slot->location;
+	// not active at link time (or a name the driver spells differently): ask once, then remember the answer
+	++uniformCacheMisses;
+	++totalUniformCacheMisses;
+	int location = glGetUniformLocation(ID, name.c_str());
+	insertUniform(name, location, GL_NONE);
+	return location;
+}
+
+void Shader::cacheActiveUniforms() const
+{
+	int count = 0, maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	uniformTable.assign(16, UniformSlot());
+	uniformCount = 0;
+	std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+	for (int i = 0; i < count; ++i)
+	{
+		int length = 0, size = 0;
+		GLenum type = GL_NONE;
+		glGetActiveUniform(ID, (unsigned int)i, (int)nameBuffer.size(), &length, &size, &type, &nameBuffer[0]);
+		std::string name(&nameBuffer[0], length);
+		int location = glGetUniformLocation(ID, name.c_str());
+		if (location < 0)
+			continue; // member of a uniform block
+		// arrays are reported as "name[0]": register the bare name and every element
+		size_t bracket = name.find('[');
+		if (bracket == std::string::npos)
+		{
+			insertUniform(name, location, type);
+			continue;
+		}
+		std::string baseName = name.substr(0, bracket);
+		insertUniform(baseName, location, type);
+		for (int element = 0; element < size; ++element)
+		{
+			std::string elementName = baseName + "[" + std::to_string(element) + "]";
+			insertUniform(elementName, glGetUniformLocation(ID, elementName.c_str()), type);
+		}
+	}
+}
+
+void Shader::insertUniform(const std::string& name, int location, GLenum type) const
+{
+	// keep the load factor under one half
+	if ((uniformCount + 1) * 2 > uniformTable.size())
+	{
+		std::vector<UniformSlot> old;
+		old.swap(uniformTable);
+		uniformTable.assign(old.size() * 2 > 16 ? old.size() * 2 : 16, UniformSlot());
+		uniformCount = 0;
+		for (const UniformSlot& slot : old)
+		{
+			if (slot.used)
+				insertUniform(slot.name, slot.location, slot.type);
+		}
+	}
+	unsigned int hash = hashUniformName(name.c_str(), name.size());
+	size_t mask = uniformTable.size() - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask)
+	{
+		UniformSlot& slot = uniformTable[i];
+		if (slot.used && !(slot.hash == hash && slot.name == name))
+			continue;
+		if (!slot.used)
+			++uniformCount;
+		slot.name = name;
+		slot.hash = hash;
+		slot.location = location;
+		slot.type = type;
+		slot.used = true;
+		return;
+	}
+}
+
+const Shader::UniformSlot* Shader::findUniform(const std::string& name, unsigned int hash) const
+{
+	if (uniformTable.empty())
+		return nullptr;
+	size_t mask = uniformTable.size() - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask)
+	{
+		const UniformSlot& slot = uniformTable[i];
+		if (!slot.used)
+			return nullptr;
+		if (slot.hash == hash && slot.name == name)
+			return &slot;
+	}
+}
+
+GLenum Shader::findUniformType(const std::string& name) const
+{
+	const UniformSlot* slot = findUniform(name, hashUniformName(name.c_str(), name.size()));
+	return slot ? slot->type : GL_NONE;
+}
+
+void Shader::checkUniformType(const std::string& name, bool matches) const
+{
+	if (!matches)
+		std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH " << name << std::endl;
+}
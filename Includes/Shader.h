@@ -3,80 +3,190 @@
 
 #include <string>
 #include <fstream>
+#include <vector>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+class ProgramCache;
+
+// A uniform location resolved once and kept by the caller; T is the C++ type it is set with
+template <typename T>
+struct UniformHandle
+{
+    int location = -1;
+};
+
+// "#define name value", injected after a stage's #version line to specialize it
+struct ShaderDefine
+{
+    std::string name;
+    std::string value;
+};
+
+// Stage sources may #include "file" relative to themselves; #line directives keep compiler messages pointing at
+// the original files (source string 0 is the stage file, includes are numbered from 1 in the order reached).
+// With a program cache set, linked programs are restored from it instead of compiled whenever the sources match.
+// Construction only submits the compile and link; the status is checked (and errors reported) the first time the
+// program is used, so with parallel compile the driver works on it in the background until then.
 class Shader
 {
 public:
     unsigned int ID;
 
-    Shader(const char* vertexPath, const char* fragmentPath);
+    Shader(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<ShaderDefine>& defines = {});
+    // compute program; needs a GL 4.3 context
+    explicit Shader(const std::string& computePath, const std::vector<ShaderDefine>& defines = {});
     void use();
+
+    // turns on GL_KHR_parallel_shader_compile (or the ARB version) when the context has it; call once after
+    // loading GL, before constructing shaders
+    static bool enableParallelCompile(GLADloadproc load);
+    static bool isParallelCompile();
+    // true once the driver has finished the program; never blocks, and is always true without parallel compile
+    // because the only way to ask would be to wait
+    bool isReady() const;
+    // waits for the program, reports compile and link errors and reads the active uniforms; every use does this
+    void finish() const;
+    bool isLinked() const { finish(); return linked; }
+
+    // cache used by every Shader constructed afterwards; nullptr (the default) always compiles
+    static void setProgramCache(ProgramCache* cache) { programCache = cache; }
+
+    // location of a uniform from the table filled at link time; names missing from it are queried once and counted
+    int getUniformLocation(const std::string& name) const;
+    unsigned int getUniformCacheMisses() const { return uniformCacheMisses; }
+    // misses of every Shader in the process, including ones since destroyed
+    static unsigned int getTotalUniformCacheMisses();
+    // resolves a typed handle, warning when T does not match the uniform's declared type
+    template <typename T>
+    UniformHandle<T> getUniform(const std::string& name) const
+    {
+        UniformHandle<T> handle;
+        handle.location = getUniformLocation(name);
+        checkUniformType(name, uniformTypeMatches<T>(findUniformType(name)));
+        return handle;
+    }
+    void set(UniformHandle<bool> handle, bool value) const { glUniform1i(handle.location, (int)value); }
+    void set(UniformHandle<int> handle, int value) const { glUniform1i(handle.location, value); }
+    void set(UniformHandle<float> handle, float value) const { glUniform1f(handle.location, value); }
+    void set(UniformHandle<glm::vec2> handle, const glm::vec2& value) const { glUniform2fv(handle.location, 1, &value[0]); }
+    void set(UniformHandle<glm::vec3> handle, const glm::vec3& value) const { glUniform3fv(handle.location, 1, &value[0]); }
+    void set(UniformHandle<glm::vec4> handle, const glm::vec4& value) const { glUniform4fv(handle.location, 1, &value[0]); }
+    void set(UniformHandle<glm::mat3> handle, const glm::mat3& mat) const { glUniformMatrix3fv(handle.location, 1, GL_FALSE, &mat[0][0]); }
+    void set(UniformHandle<glm::mat4> handle, const glm::mat4& mat) const { glUniformMatrix4fv(handle.location, 1, GL_FALSE, &mat[0][0]); }
+
     void set1b(const std::string& name, bool value) const;
     void set1i(const std::string& name, int value) const;
     void set1f(const std::string& name, float value) const;
+    void set2i(const std::string& name, int value1, int value2) const;
     void set4f(const std::string& name, float value1, float value2, float value3, float value4) const;
     void set2fv(const std::string& name, int count, float* valueArr) const;
+    // attaches the named uniform block to a binding point; blocks the program does not use are ignored
+    void bindUniformBlock(const std::string& name, unsigned int binding) const;
 
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(getUniformLocation(name), (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec2(const std::string& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(getUniformLocation(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(getUniformLocation(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec4(const std::string& name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(getUniformLocation(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
+
+private:
+    static ProgramCache* programCache;
+
+    // stages submitted but not yet checked; pending until finish()
+    mutable unsigned int stages[2] = { 0, 0 };
+    mutable int stageCount = 0;
+    mutable bool pending = false;
+    mutable bool linked = false;
+    unsigned long long cacheKey = 0;
+
+    void submitStage(GLenum type, const std::string& source);
+    void submitLink();
+
+    // flat open-addressing table keyed by uniform name, filled from glGetActiveUniform after linking
+    struct UniformSlot
+    {
+        std::string name;
+        unsigned int hash = 0;
+        int location = -1;
+        GLenum type = GL_NONE; // GL_NONE for names that were not active at link time
+        bool used = false;
+    };
+    mutable std::vector<UniformSlot> uniformTable;
+    mutable unsigned int uniformCount = 0;
+    mutable unsigned int uniformCacheMisses = 0;
+
+    void cacheActiveUniforms() const;
+    void insertUniform(const std::string& name, int location, GLenum type) const;
+    const UniformSlot* findUniform(const std::string& name, unsigned int hash) const;
+    GLenum findUniformType(const std::string& name) const;
+    void checkUniformType(const std::string& name, bool matches) const;
+
+    template <typename T>
+    static bool uniformTypeMatches(GLenum type);
 };
 
+// GL_NONE (unknown uniform) matches anything; int handles also drive samplers and bools
+template <> inline bool Shader::uniformTypeMatches<bool>(GLenum type) { return type == GL_NONE || type == GL_BOOL; }
+template <> inline bool Shader::uniformTypeMatches<int>(GLenum type) { return type == GL_NONE || type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_2D_ARRAY || type == GL_SAMPLER_3D || type == GL_SAMPLER_CUBE; }
+template <> inline bool Shader::uniformTypeMatches<float>(GLenum type) { return type == GL_NONE || type == GL_FLOAT; }
+template <> inline bool Shader::uniformTypeMatches<glm::vec2>(GLenum type) { return type == GL_NONE || type == GL_FLOAT_VEC2; }
+template <> inline bool Shader::uniformTypeMatches<glm::vec3>(GLenum type) { return type == GL_NONE || type == GL_FLOAT_VEC3; }
+template <> inline bool Shader::uniformTypeMatches<glm::vec4>(GLenum type) { return type == GL_NONE || type == GL_FLOAT_VEC4; }
+template <> inline bool Shader::uniformTypeMatches<glm::mat3>(GLenum type) { return type == GL_NONE || type == GL_FLOAT_MAT3; }
+template <> inline bool Shader::uniformTypeMatches<glm::mat4>(GLenum type) { return type == GL_NONE || type == GL_FLOAT_MAT4; }
+
 #endif
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef SHADER_PERMUTATIONS_H
+#define SHADER_PERMUTATIONS_H
+
+#include "Shader.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Variants of one vertex/fragment program specialized by #defines, compiled the first time they are asked for
+// and kept for the rest of the run. Uniform locations differ between variants, so every variant carries its own
+// Bindings (the caller's struct of UniformHandles), built by the setup callback right after the variant links;
+// the callback also makes the one-time settings (sampler units, block bindings). Submit starts a variant's compile
+// without waiting for it; the setup runs on the first Get.
+template <typename Bindings>
+class ShaderPermutations
+{
+public:
+    struct Variant
+    {
+        std::unique_ptr<Shader> shader;
+        Bindings uniforms;
+        bool setUp = false;
+    };
+    typedef std::function<Bindings(Shader&)> Setup;
+
+    ShaderPermutations(std::string vertexPath, std::string fragmentPath, Setup setup)
+        : vertexPath(std::move(vertexPath)), fragmentPath(std::move(fragmentPath)), setup(std::move(setup)) {}
+
+    Variant& Get(const std::vector<ShaderDefine>& defines)
+    {
+        Variant& variant = Submit(defines);
+        if (variant.setUp)
+            return variant;
+        auto start = std::chrono::steady_clock::now();
+        variant.uniforms = setup(*variant.shader);
+        variant.setUp = true;
+        compileMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return variant;
+    }
+
+    Variant& Submit(const std::vector<ShaderDefine>& defines)
+    {
+        std::string key;
+        for (const ShaderDefine& define : defines)
+            key += define.name + "=" + define.value + ";";
+        auto found = variants.find(key);
+        if (found != variants.end())
+            return found->second;
+        auto start = std::chrono::steady_clock::now();
+        Variant& variant = variants[key];
+        variant.shader.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines));
+        compileMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return variant;
+    }
+
+    // runs fn on every variant compiled so far, e.g. to change a setting they all share
+    void ForEach(const std::function<void(Variant&)>& fn)
+    {
+        for (auto& entry : variants)
+            fn(entry.second);
+    }
+
+    int GetCount() const { return (int)variants.size(); }
+    // time spent submitting, waiting for and setting up variants so far
+    double GetCompileMs() const { return compileMs; }
+
+private:
+    std::string vertexPath, fragmentPath;
+    Setup setup;
+    std::unordered_map<std::string, Variant> variants;
+    double compileMs = 0.0;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that split index ranges (typically image rows) between them.
+// The calling thread takes part in the work, so a pool of size 1 has no workers and runs inline.
+class ThreadPool
+{
+public:
+    // threadCount of 0 uses every hardware thread
+    explicit ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 1;
+        for (unsigned int i = 1; i < threadCount; ++i)
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeWorkers.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int Size() const
+    {
+        return (unsigned int)workers.size() + 1;
+    }
+
+    // runs body(chunkBegin, chunkEnd) over [begin, end) in chunks of 'grain' indices and blocks until all are done
+    void ParallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body)
+    {
+        if (end <= begin)
+            return;
+        if (grain < 1)
+            grain = 1;
+        if (workers.empty() || end - begin <= grain)
+        {
+            body(begin, end);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobBody = &body;
+            jobEnd = end;
+            jobGrain = grain;
+            jobNext = begin;
+            busyWorkers = (unsigned int)workers.size();
+            ++generation;
+        }
+        wakeWorkers.notify_all();
+        runChunks();
+        std::unique_lock<std::mutex> lock(mutex);
+        jobDone.wait(lock, [this] { return busyWorkers == 0; });
+        jobBody = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeWorkers, jobDone;
+    const std::function<void(int, int)>* jobBody = nullptr;
+    std::atomic<int> jobNext{ 0 };
+    int jobEnd = 0, jobGrain = 1;
+    unsigned int busyWorkers = 0;
+    unsigned long long generation = 0;
+    bool stopping = false;
+
+    void runChunks()
+    {
+        for (;;)
+        {
+            int chunkBegin = jobNext.fetch_add(jobGrain);
+            if (chunkBegin >= jobEnd)
+                return;
+            int chunkEnd = chunkBegin + jobGrain < jobEnd ? chunkBegin + jobGrain : jobEnd;
+            (*jobBody)(chunkBegin, chunkEnd);
+        }
+    }
+
+    void workerLoop()
+    {
+        unsigned long long seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeWorkers.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            runChunks();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --busyWorkers;
+            }
+            jobDone.notify_one();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// Binding points of the std140 uniform blocks shared between programs
+enum UniformBlockBinding
+{
+    UBO_BINDING_CAMERA = 0,     // "Camera": per-frame matrices
+    UBO_BINDING_SSAO_KERNEL = 1, // "SSAOKernel": sample kernel, re-uploaded only when it changes
+    UBO_BINDING_AO_PARAMS = 2,  // "AOParams": occlusion pass settings
+};
+
+// C++ mirrors of the blocks; members are ordered and padded for std140
+struct CameraBlock
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::mat4 invProjection; // positions are reconstructed from the depth buffer
+};
+
+struct AOParamsBlock
+{
+    int aoMethod;
+    int kernelSize;
+    float radius;
+    int rangeCheck;
+    float ssaoPower;
+    int hbaoDirections;
+    int hbaoSteps;
+    float noiseRotation;
+    int kernelStride;
+    int kernelPhase;
+    int depthMaxLevel;
+    int adaptiveSamples;
+    float adaptiveFullRadius;
+    float adaptiveFalloffDepth;
+    float adaptiveTolerance;
+    int aoHeatmap;
+    int kernelHemisphere;
+    float padding[3];
+};
+
+template <int N>
+struct SSAOKernelBlock
+{
+    glm::vec4 samples[N]; // std140 array stride is 16 bytes, w unused
+};
+
+// A uniform buffer object permanently attached to one binding point
+class UniformBuffer
+{
+public:
+    unsigned int ID;
+
+    UniformBuffer(unsigned int binding, size_t size)
+    {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+
+    ~UniformBuffer()
+    {
+        glDeleteBuffers(1, &ID);
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    void Update(const void* data, size_t dataSize, size_t offset = 0)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, dataSize, data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    template <typename T>
+    void Update(const T& block)
+    {
+        Update(&block, sizeof(T));
+    }
+};
+
+#endif
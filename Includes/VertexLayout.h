@@ -0,0 +1,158 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifndef GL_INT_2_10_10_10_REV
+#define GL_INT_2_10_10_10_REV 0x8D9F
+#endif
+
+// Compile-time vertex layouts for GeometryArena. A layout splits the vertex into a position stream (the only one
+// a depth-only pass needs) and an attribute stream, each a plain struct, and lists the attributes of each as
+// VertexAttribute descriptors. Encode converts a Mesh Vertex; positions are passed in the unit cube of the
+// arena's bounds, so layouts may store them as fixed point and the vertex shader maps them back with
+// positionScale and positionOffset.
+
+// One vertex attribute: shader location, component count and type, whether integers are normalized, and the
+// byte offset inside its stream's struct
+template <unsigned int Location, int Components, GLenum Type, bool Normalized, size_t Offset>
+struct VertexAttribute
+{
+    static void Enable(GLsizei stride)
+    {
+        glEnableVertexAttribArray(Location);
+        glVertexAttribPointer(Location, Components, Type, Normalized ? GL_TRUE : GL_FALSE, stride, (void*)Offset);
+    }
+};
+
+// Enables the attributes of one stream; its buffer must be bound to GL_ARRAY_BUFFER
+template <typename Stream, typename... Attributes>
+struct VertexStream
+{
+    static void Enable()
+    {
+        (Attributes::Enable((GLsizei)sizeof(Stream)), ...);
+    }
+};
+
+namespace VertexEncoding
+{
+    // IEEE half with round-to-nearest; values beyond the half range become infinity, tiny ones zero
+    inline uint16_t FloatToHalf(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000u;
+        int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+        uint32_t mantissa = bits & 0x7FFFFFu;
+        if (((bits >> 23) & 0xFF) == 0xFF)
+            return (uint16_t)(sign | 0x7C00u | (mantissa ? 0x200u : 0u)); // inf / nan
+        if (exponent >= 31)
+            return (uint16_t)(sign | 0x7C00u);
+        if (exponent <= 0)
+        {
+            if (exponent < -10)
+                return (uint16_t)sign;
+            mantissa |= 0x800000u; // subnormal half
+            uint32_t shift = (uint32_t)(14 - exponent);
+            uint32_t half = mantissa >> shift;
+            if ((mantissa >> (shift - 1)) & 1u)
+                ++half;
+            return (uint16_t)(sign | half);
+        }
+        uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+        if (mantissa & 0x1000u)
+            ++half; // a carry into the exponent is still the correctly rounded value
+        return (uint16_t)half;
+    }
+
+    // xyz in [-1, 1] as signed normalized 10:10:10 (GL_INT_2_10_10_10_REV), w = 0
+    inline uint32_t PackSnorm10(const glm::vec3& v)
+    {
+        auto component = [](float value)
+        {
+            int quantized = (int)std::lround(std::max(-1.0f, std::min(1.0f, value)) * 511.0f);
+            return (uint32_t)quantized & 0x3FFu;
+        };
+        return component(v.x) | (component(v.y) << 10) | (component(v.z) << 20);
+    }
+
+    inline uint16_t PackUnorm16(float value)
+    {
+        return (uint16_t)std::lround(std::max(0.0f, std::min(1.0f, value)) * 65535.0f);
+    }
+}
+
+// 32 B per vertex: float position (12 B) and float normal and texture coordinates (20 B), all the geometry pass
+// reads of the 88 B Mesh vertex
+struct FloatVertexLayout
+{
+    static constexpr const char* Name = "float";
+    static constexpr bool QuantizedPositions = false;
+
+    struct Position
+    {
+        float position[3];
+    };
+    struct Attributes
+    {
+        float normal[3];
+        float texCoords[2];
+    };
+    typedef VertexStream<Position, VertexAttribute<0, 3, GL_FLOAT, false, offsetof(Position, position)>> PositionStream;
+    typedef VertexStream<Attributes, VertexAttribute<1, 3, GL_FLOAT, false, offsetof(Attributes, normal)>,
+                         VertexAttribute<2, 2, GL_FLOAT, false, offsetof(Attributes, texCoords)>> AttributeStream;
+
+    static void Encode(const Vertex& vertex, const glm::vec3& unitPosition, Position& position, Attributes& attributes)
+    {
+        (void)unitPosition;
+        position = { { vertex.Position.x, vertex.Position.y, vertex.Position.z } };
+        attributes = { { vertex.Normal.x, vertex.Normal.y, vertex.Normal.z }, { vertex.TexCoords.x, vertex.TexCoords.y } };
+    }
+};
+
+// 16 B per vertex: 16-bit unorm position in the arena bounds (8 B, padded for alignment), 10:10:10 snorm normal
+// (4 B) and half-float texture coordinates (4 B)
+struct QuantizedVertexLayout
+{
+    static constexpr const char* Name = "quantized";
+    static constexpr bool QuantizedPositions = true;
+
+    struct Position
+    {
+        uint16_t position[4];
+    };
+    struct Attributes
+    {
+        uint32_t normal;
+        uint16_t texCoords[2];
+    };
+    typedef VertexStream<Position, VertexAttribute<0, 3, GL_UNSIGNED_SHORT, true, offsetof(Position, position)>> PositionStream;
+    typedef VertexStream<Attributes, VertexAttribute<1, 4, GL_INT_2_10_10_10_REV, true, offsetof(Attributes, normal)>,
+                         VertexAttribute<2, 2, GL_HALF_FLOAT, false, offsetof(Attributes, texCoords)>> AttributeStream;
+
+    static void Encode(const Vertex& vertex, const glm::vec3& unitPosition, Position& position, Attributes& attributes)
+    {
+        using namespace VertexEncoding;
+        position = { { PackUnorm16(unitPosition.x), PackUnorm16(unitPosition.y), PackUnorm16(unitPosition.z), 0 } };
+        glm::vec3 normal = glm::length(vertex.Normal) > 0.0f ? glm::normalize(vertex.Normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+        attributes.normal = PackSnorm10(normal);
+        attributes.texCoords[0] = FloatToHalf(vertex.TexCoords.x);
+        attributes.texCoords[1] = FloatToHalf(vertex.TexCoords.y);
+    }
+};
+
+static_assert(sizeof(FloatVertexLayout::Position) + sizeof(FloatVertexLayout::Attributes) == 32, "float layout is 32 B per vertex");
+static_assert(sizeof(QuantizedVertexLayout::Position) + sizeof(QuantizedVertexLayout::Attributes) == 16,
+              "quantized layout is 16 B per vertex");
+
+#endif
@@ -9,13 +9,33 @@
 #include "Includes/Imgui/imgui_impl_opengl3.h"
 
 #include "Includes/Shader.h"
+#include "Includes/ShaderPermutations.h"
+#include "Includes/ProgramCache.h"
 #include "Includes/Filesystem.h"
 #include "Includes/Camera.h"
 #include "Includes/Model.h"
+#include "Includes/Headless.h"
+#include "Includes/CpuSSAO.h"
+#include "Includes/GpuTimer.h"
+#include "Includes/InstanceBuffer.h"
+#include "Includes/GeometryArena.h"
+#include "Includes/OverdrawCounter.h"
+#include "Includes/UniformBuffer.h"
+#include "Includes/GBufferLayout.h"
+#include "Includes/GLCompute.h"
+#include "Includes/SSAOKernel.h"
+#include "Includes/RenderTargets.h"
+#include "Includes/DynamicResolution.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <random>
 #include <string>
+#include <thread>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -26,12 +46,16 @@ void renderQuad();
 void renderCube();
 
 void UpdateSSAOKernel();
+std::vector<ShaderDefine> GetOcclusionDefines();
 
-// Viewport
+// Viewport: the initial window size; the render targets follow the framebuffer from there
 constexpr unsigned int SCR_WIDTH = 1920;
 constexpr unsigned int SCR_HEIGHT = 1080;
+int screenWidth = SCR_WIDTH, screenHeight = SCR_HEIGHT; // current framebuffer size, set by framebuffer_size_callback
 constexpr int MAX_KERNEL_SIZE = 128;
 constexpr int NOISE_TEXTURE_SIZE = 4;
+constexpr int MAX_DEPTH_MIP = 5;
+constexpr int COMPUTE_AO_TILE = 32; // TILE_SIZE of SSAOOcclusionBlurCShader.comp
 
 // Camera
 Camera camera(glm::vec3(0.0f, 0.0f, 5.0f));
@@ -44,182 +68,632 @@ float deltaTime = 0.f, lastFrame = 0.f;
 
 // SSAO
 int ModelObj = 0; // 0: Backpack, 1: Teapot, 2: Tiger
+// Teapot and tiger grids: --grid N instances per side, drawn with one instanced draw per mesh unless --no-instancing
+int InstanceGridSize = 7;
+bool InstancedDraw = true;
+// Each model's meshes merged into one buffer and drawn with multi-draw indirect (--no-merged-geometry: per mesh)
+bool MergedGeometry = true;
+// Vertex streams of the merged geometry (--vertex-format float|quantized, see Includes/VertexLayout.h)
+enum VertexFormatId { VERTEX_FORMAT_FLOAT, VERTEX_FORMAT_QUANTIZED };
+int VertexFormat = VERTEX_FORMAT_QUANTIZED;
+// Depth-only pass before the G-buffer pass, which then shades each pixel once with GL_EQUAL (--depth-prepass)
+bool DepthPrepass = false;
 int AOMethod = 2; // 0: None, 1: SSAO, 2: HBAO
-std::vector<glm::vec3> ssaoKernel, hbaoKernel, ssaoNoise;
+std::vector<glm::vec3> ssaoKernel, ssaoNoise;
 int ssaoKernelSize = MAX_KERNEL_SIZE / 2;
+int KernelType = KERNEL_HAMMERSLEY; // --kernel: see KernelDistribution
 float SSAORadius = 1.0f;
 bool SSAORangeCheck = true;
 float SSAOPower = 1.0f;
+int HBAODirections = 8;
+int HBAOSteps = 6;
+// Adaptive tap count (--adaptive): full taps from AdaptiveFullRadius projected pixels and closer than
+// AdaptiveFalloffDepth, fewer below, and an early exit once the estimate's standard error is under the tolerance
+bool AOAdaptive = false;
+float AdaptiveFullRadius = 64.0f;
+float AdaptiveFalloffDepth = 8.0f;
+float AdaptiveTolerance = 0.04f;
+bool AOHeatmap = false; // --heatmap: show taps per pixel instead of the lit scene
 std::uniform_real_distribution<float> randomFloats(0.f, 1.f);
 std::default_random_engine generator;
 bool SSAOEnableBlur = true;
+int SSAOBlurMode = 1; // 0: Box 4x4 (matches the CPU reference), 1: Separable bilateral
+int SSAOBlurRadius = 4;
+int AOResolutionScale = 1; // AO is computed at 1/scale of the screen: 1, 2 or 4
+bool AODepthMips = false; // build a linear depth pyramid and let far taps read coarser levels
+bool AODeinterleaved = false; // run the occlusion pass on 16 quarter resolution depth layers for texture cache locality
+bool SSAOTemporal = false; // accumulate AO over frames with reprojection, so 8-16 samples per frame suffice
+float TemporalBlend = 0.1f; // weight of the current frame in the moving average
+// Occlusion + blur in one compute dispatch (GL 4.3+) or as the fragment passes; the compute path covers the
+// single-frame, interleaved, full-depth configurations and the fragment path runs everything else
+enum OcclusionPath { OCCLUSION_FRAGMENT, OCCLUSION_COMPUTE };
+int AOPath = OCCLUSION_COMPUTE; // --ao-path; lowered to OCCLUSION_FRAGMENT at startup when compute is unavailable or --cpu-reference is set
+// Occlusion fragment shader variants with the method, range check and SSAO loop bound compiled in
+// (--no-permutations: the generic variant that branches on the uniforms)
+bool OcclusionPermutations = true;
+
+// Dynamic resolution (--budget MS): the geometry and AO passes run at RenderScale of the output size, which
+// DynamicResolution lowers and raises to keep the GPU frame time under FrameBudgetMs; the lighting pass upscales
+bool DynamicResolutionEnabled = false;
+float FrameBudgetMs = 8.0f;
+float RenderScale = 1.0f; // --render-scale; set by the controller while dynamic resolution is on
+
+// G-buffer layout (--gbuffer): see GBufferProfileId
+int GBufferProfile = GBUFFER_REFERENCE;
+const glm::vec3 MaterialAlbedo = glm::vec3(0.55f); // albedo of materials that do not sample a texture
+
+// Headless (--headless): offscreen context, fixed frame count, results written to disk
+bool HeadlessMode = false;
+int HeadlessFrames = 100;
+string HeadlessOutput = "ssao";
+bool CpuReference = false; // --cpu-reference: compare against the CPU engine and report its thread scaling
+
+// Linked programs are kept in ShaderCache/ next to the executable (--no-program-cache compiles everything,
+// --clear-program-cache empties the cache first to measure a cold start)
+bool UseProgramCache = true;
+bool ClearProgramCache = false;
+
+// Textures and framebuffers owned by RenderTargets
+enum RenderTargetId { RT_G_NORMAL, RT_G_ALBEDO, RT_G_DEPTH, RT_AO_RAW, RT_AO_BLUR_TEMP, RT_AO_BLUR, RT_AO_DEPTH, RT_AO_NORMAL, RT_AO_UPSAMPLED,
+                      RT_AO_HISTORY0, RT_AO_HISTORY1, RT_DEPTH_PYRAMID, RT_DEINTERLEAVED_DEPTH, RT_DEINTERLEAVED_AO, RT_OUTPUT_COLOR,
+                      RT_OUTPUT_DEPTH, RT_COUNT };
+enum FramebufferId { FB_GBUFFER, FB_AO, FB_AO_BLUR_TEMP, FB_AO_BLUR, FB_AO_GUIDE, FB_AO_UPSAMPLE, FB_AO_HISTORY0, FB_AO_HISTORY1,
+                     FB_DEPTH_PYRAMID, FB_DEINTERLEAVE, FB_OUTPUT, FB_COUNT };
+
+// Per-variant handles of the occlusion shader
+struct OcclusionUniforms
+{
+    UniformHandle<bool> deinterleaved;
+    UniformHandle<int> layer;
+};
+
+// Programs the scene is drawn with: the G-buffer pass, or the depth pre-pass
+struct ScenePrograms
+{
+    Shader* plain;
+    Shader* instanced;
+    UniformHandle<glm::mat4> model;
+    UniformHandle<bool> invertedNormals;
+    UniformHandle<glm::vec3> positionScale, positionOffset;
+    UniformHandle<glm::vec3> instancedPositionScale, instancedPositionOffset;
+    bool depthOnly;
+};
+
+// GPU pass timing
+enum RenderPass { PASS_DEPTH_PREPASS, PASS_GEOMETRY, PASS_DOWNSAMPLE, PASS_DEPTH_MIPS, PASS_DEINTERLEAVE, PASS_OCCLUSION, PASS_COMPUTE_AO, PASS_REINTERLEAVE, PASS_TEMPORAL, PASS_BLUR, PASS_UPSAMPLE, PASS_LIGHTING, PASS_COUNT };
+bool RecordTimingCsv = false;
+string TimingCsvPath = "ssao_timings.csv";
 
 int main(int argc, char* argv[])
 {
     string curDir = string(argv[0]);
-    curDir = curDir.substr(0, curDir.find_last_of("\\")+1);
-    glfwInit();
-    glfwSetTime(0);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    const char* glsl_version = "#version 330";
-
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "SSAO Demo", nullptr, nullptr);
-    if (!window)
+    curDir = curDir.substr(0, curDir.find_last_of("\\/")+1);
+    for (int i = 1; i < argc; ++i)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        string arg = argv[i];
+        if (arg == "--headless")
+            HeadlessMode = true;
+        else if (arg == "--frames" && i + 1 < argc)
+            HeadlessFrames = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--output" && i + 1 < argc)
+            HeadlessOutput = argv[++i];
+        else if (arg == "--cpu-reference")
+            CpuReference = true;
+        else if (arg == "--no-program-cache")
+            UseProgramCache = false;
+        else if (arg == "--clear-program-cache")
+            ClearProgramCache = true;
+        else if (arg == "--csv" && i + 1 < argc)
+        {
+            RecordTimingCsv = true;
+            TimingCsvPath = argv[++i];
+        }
+        else if (arg == "--ao-scale" && i + 1 < argc)
+        {
+            AOResolutionScale = std::atoi(argv[++i]);
+            if (AOResolutionScale != 2 && AOResolutionScale != 4)
+                AOResolutionScale = 1;
+        }
+        else if (arg == "--budget" && i + 1 < argc)
+        {
+            DynamicResolutionEnabled = true;
+            FrameBudgetMs = std::max(0.5f, (float)std::atof(argv[++i]));
+        }
+        else if (arg == "--render-scale" && i + 1 < argc)
+            RenderScale = DynamicResolution::Quantize((float)std::atof(argv[++i]));
+        else if (arg == "--gbuffer" && i + 1 < argc)
+        {
+            GBufferProfile = std::atoi(argv[++i]);
+            if (GBufferProfile < 0 || GBufferProfile >= GBUFFER_PROFILE_COUNT)
+                GBufferProfile = GBUFFER_REFERENCE;
+        }
+        else if (arg == "--depth-mips")
+            AODepthMips = true;
+        else if (arg == "--deinterleaved")
+            AODeinterleaved = true;
+        else if (arg == "--kernel" && i + 1 < argc)
+        {
+            KernelType = std::atoi(argv[++i]);
+            if (KernelType < 0 || KernelType >= KERNEL_DISTRIBUTION_COUNT)
+                KernelType = KERNEL_HAMMERSLEY;
+        }
+        else if (arg == "--adaptive")
+            AOAdaptive = true;
+        else if (arg == "--heatmap")
+            AOHeatmap = true;
+        else if (arg == "--temporal")
+            SSAOTemporal = true;
+        else if (arg == "--no-permutations")
+            OcclusionPermutations = false;
+        else if (arg == "--ao-path" && i + 1 < argc)
+            AOPath = string(argv[++i]) == "fragment" ? OCCLUSION_FRAGMENT : OCCLUSION_COMPUTE;
+        else if (arg == "--blur" && i + 1 < argc)
+            SSAOBlurMode = string(argv[++i]) == "box" ? 0 : 1;
+        else if (arg == "--grid" && i + 1 < argc)
+            InstanceGridSize = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--no-instancing")
+            InstancedDraw = false;
+        else if (arg == "--no-merged-geometry")
+            MergedGeometry = false;
+        else if (arg == "--depth-prepass")
+            DepthPrepass = true;
+        else if (arg == "--vertex-format" && i + 1 < argc)
+            VertexFormat = string(argv[++i]) == "float" ? VERTEX_FORMAT_FLOAT : VERTEX_FORMAT_QUANTIZED;
+        else if (arg == "--model" && i + 1 < argc)
+            ModelObj = std::min(2, std::max(0, std::atoi(argv[++i])));
+        else if (arg == "--ao" && i + 1 < argc)
+            AOMethod = std::min(2, std::max(0, std::atoi(argv[++i])));
+        else
+            std::cout << "Unknown argument: " << arg << std::endl;
+    }
+
+    GLFWwindow* window = nullptr;
+    HeadlessContext headlessContext;
+    GLADloadproc loadProc = nullptr;
+    if (HeadlessMode)
+    {
+        // No window, no swap chain and therefore no vsync; 4.3 enables the compute occlusion path
+        if (!headlessContext.Create(4, 3) && !headlessContext.Create(3, 3))
+        {
+            std::cout << "Failed to create headless context" << std::endl;
+            return -1;
+        }
+        loadProc = (GLADloadproc)HeadlessContext::GetProcAddress;
+        if (!gladLoadGLLoader(loadProc))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            headlessContext.Destroy();
+            return -1;
+        }
     }
-    glfwMakeContextCurrent(window);
-    glfwSwapInterval(1); // Enable vsync
-    // Setup Dear ImGui context
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
+    else
+    {
+        glfwInit();
+        glfwSetTime(0);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        const char* glsl_version = "#version 330";
 
-    // Setup Dear ImGui style
-    ImGui::StyleColorsDark();
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "SSAO Demo", nullptr, nullptr);
+        if (!window)
+        {
+            // e.g. macOS stops at 4.1: run the fragment path only
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "SSAO Demo", nullptr, nullptr);
+        }
+        if (!window)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        // high-DPI displays give the framebuffer more pixels than the window has screen coordinates
+        glfwGetFramebufferSize(window, &screenWidth, &screenHeight);
+        glfwSwapInterval(1); // Enable vsync
+        // Setup Dear ImGui context
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO(); (void)io;
 
-    // Setup Platform/Renderer backends
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init(glsl_version);
+        // Setup Dear ImGui style
+        ImGui::StyleColorsDark();
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        // Setup Platform/Renderer backends
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init(glsl_version);
+
+        loadProc = (GLADloadproc)glfwGetProcAddress;
+        if (!gladLoadGLLoader(loadProc))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
     }
 
-    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    glViewport(0, 0, screenWidth, screenHeight);
     glEnable(GL_DEPTH_TEST);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetKeyCallback(window, key_callback);
+    if (!HeadlessMode)
+    {
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetKeyCallback(window, key_callback);
+    }
 
     // Init shaders
-    Shader shaderGeometryPass("Shaders/SSAOGeometryVShader.vs", "Shaders/SSAOGeometryFShader.fs");
-    Shader shaderOcclusion("Shaders/SSAO.vs", "Shaders/SSAOOcclusionFShader.fs");
-    Shader shaderBlur("Shaders/SSAO.vs", "Shaders/SSAOBlurFShader.fs");
-    Shader shaderLightingPass("Shaders/SSAO.vs", "Shaders/SSAOLightFShader.fs");
-    shaderOcclusion.use();
-    shaderOcclusion.setInt("gPosition", 0);
-    shaderOcclusion.setInt("gNormal", 1);
-    shaderOcclusion.setInt("texNoise", 2);
+    auto shaderStart = std::chrono::steady_clock::now();
+    ProgramCache programCache;
+    if (UseProgramCache && programCache.Load(loadProc, curDir + "ShaderCache"))
+    {
+        if (ClearProgramCache)
+            programCache.Clear();
+        Shader::setProgramCache(&programCache);
+    }
+    // Shaders are only submitted here and checked on first use, so with parallel compile the driver links them
+    // while the models load; the timeline printed below shows how much of it overlapped
+    const bool parallelCompile = Shader::enableParallelCompile(loadProc);
+    struct TimelineEvent { string what; double ms; };
+    std::vector<TimelineEvent> startupTimeline;
+    std::vector<const Shader*> startupShaders;
+    auto markStartup = [&](const string& what)
+    {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderStart).count();
+        if (parallelCompile && !startupShaders.empty())
+        {
+            int ready = 0;
+            for (const Shader* shader : startupShaders)
+                ready += shader->isReady();
+            startupTimeline.push_back({ what + " (" + std::to_string(ready) + "/" + std::to_string(startupShaders.size()) + " programs ready)", ms });
+        }
+        else
+        {
+            startupTimeline.push_back({ what, ms });
+        }
+    };
+    Shader shaderGeometryPass(curDir + "Shaders/SSAOGeometryVShader.vs", curDir + "Shaders/SSAOGeometryFShader.fs");
+    Shader shaderGeometryInstanced(curDir + "Shaders/SSAOGeometryVShader.vs", curDir + "Shaders/SSAOGeometryFShader.fs", { { "INSTANCED", "1" } });
+    Shader shaderDepthPrepass(curDir + "Shaders/SSAOGeometryVShader.vs", curDir + "Shaders/SSAODepthOnlyFShader.fs", { { "DEPTH_ONLY", "1" } });
+    Shader shaderDepthPrepassInstanced(curDir + "Shaders/SSAOGeometryVShader.vs", curDir + "Shaders/SSAODepthOnlyFShader.fs",
+                                       { { "DEPTH_ONLY", "1" }, { "INSTANCED", "1" } });
+    Shader shaderBlur(curDir + "Shaders/SSAO.vs", curDir + "Shaders/SSAOBlurFShader.fs");
+    Shader shaderBilateralBlur(curDir + "Shaders/SSAO.vs", curDir + "Shaders/SSAOBilateralBlurFShader.fs");
+    Shader shaderLightingPass(curDir + "Shaders/SSAO.vs", curDir + "Shaders/SSAOLightFShader.fs");
+    Shader shaderDownsample(curDir + "Shaders/SSAO.vs", curDir + "Shaders/SSAODownsampleFShader.fs");
+    Shader shaderUpsample(curDir + "Shaders/SSAO.vs", curDir + "Shaders/SSAOUpsampleFShader.fs");
+    Shader shaderTemporal(curDir + "Shaders/SSAO.vs", curDir + "Shaders/SSAOTemporalFShader.fs");
+    Shader shaderDepthMip(curDir + "Shaders/SSAO.vs", curDir + "Shaders/SSAODepthMipFShader.fs");
+    Shader shaderDeinterleave(curDir + "Shaders/SSAO.vs", curDir + "Shaders/SSAODeinterleaveFShader.fs");
+    Shader shaderReinterleave(curDir + "Shaders/SSAO.vs", curDir + "Shaders/SSAOReinterleaveFShader.fs");
+    // Compute occlusion + blur, only where the context can run it
+    GLCompute glCompute;
+    std::unique_ptr<Shader> shaderComputeAO;
+    if (glCompute.Load(loadProc))
+        shaderComputeAO.reset(new Shader(curDir + "Shaders/SSAOOcclusionBlurCShader.comp"));
+    // Occlusion variants, compiled when a frame first needs them; the generic one is submitted up front so shader
+    // errors show at startup
+    ShaderPermutations<OcclusionUniforms> occlusionShaders(curDir + "Shaders/SSAO.vs", curDir + "Shaders/SSAOOcclusionFShader.fs", [](Shader& shader)
+    {
+        shader.use();
+        shader.setInt("gDepth", 0);
+        shader.setInt("gNormal", 1);
+        shader.setInt("texNoise", 2);
+        shader.setInt("depthLayers", 3);
+        shader.setInt("depthPyramid", 4);
+        shader.setBool("octahedralNormals", GetGBufferLayout(GBufferProfile).octahedralNormals);
+        shader.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+        shader.bindUniformBlock("SSAOKernel", UBO_BINDING_SSAO_KERNEL);
+        shader.bindUniformBlock("AOParams", UBO_BINDING_AO_PARAMS);
+        OcclusionUniforms uniforms;
+        uniforms.deinterleaved = shader.getUniform<bool>("deinterleaved");
+        uniforms.layer = shader.getUniform<int>("layer");
+        return uniforms;
+    });
+    startupShaders = { &shaderGeometryPass, &shaderGeometryInstanced, &shaderDepthPrepass, &shaderDepthPrepassInstanced, &shaderBlur, &shaderBilateralBlur, &shaderLightingPass, &shaderDownsample, &shaderUpsample,
+                       &shaderTemporal, &shaderDepthMip, &shaderDeinterleave, &shaderReinterleave,
+                       occlusionShaders.Submit({}).shader.get() };
+    if (shaderComputeAO)
+        startupShaders.push_back(shaderComputeAO.get());
+    markStartup("programs submitted");
+    const double submitMs = startupTimeline.back().ms;
+
+    // Load models
+    Model backpack(curDir + "Assets/objects/backpack/backpack.obj");
+    markStartup("backpack loaded");
+    Model teapot(curDir + "Assets/objects/teapot/teapot.obj");
+    markStartup("teapot loaded");
+    Model tiger(curDir + "Assets/objects/tiger/tiger.obj");
+    markStartup("tiger loaded");
+    const double modelsLoadedMs = startupTimeline.back().ms;
+
+    // From here on every program is waited for as it is first used
+    if (shaderComputeAO && !shaderComputeAO->isLinked())
+    {
+        startupShaders.pop_back();
+        shaderComputeAO.reset();
+    }
+    const bool computeAOSupported = shaderComputeAO != nullptr;
+    // The CPU engine mirrors the fragment passes; compute tiles rebuild tap positions from their shared linear depth
+    if (!computeAOSupported || CpuReference)
+        AOPath = OCCLUSION_FRAGMENT;
+    std::cout << "GL " << glCompute.contextMajor << "." << glCompute.contextMinor << ": occlusion path "
+              << (AOPath == OCCLUSION_COMPUTE ? "compute" : !computeAOSupported ? "fragment (compute needs GL 4.3)" : "fragment (--cpu-reference)")
+              << std::endl;
+    occlusionShaders.Get({});
     shaderBlur.use();
     shaderBlur.setInt("ssaoInput", 0);
+    shaderBilateralBlur.use();
+    shaderBilateralBlur.setInt("ssaoInput", 0);
     shaderLightingPass.use();
-    shaderLightingPass.setInt("gPosition", 0);
+    shaderLightingPass.setInt("gDepth", 0);
     shaderLightingPass.setInt("gNormal", 1);
     shaderLightingPass.setInt("gAlbedo", 2);
     shaderLightingPass.setInt("ssao", 3);
+    shaderDownsample.use();
+    shaderDownsample.setInt("gDepth", 0);
+    shaderDownsample.setInt("gNormal", 1);
+    shaderUpsample.use();
+    shaderUpsample.setInt("gDepth", 0);
+    shaderUpsample.setInt("gNormal", 1);
+    shaderUpsample.setInt("aoDepth", 2);
+    shaderUpsample.setInt("aoNormal", 3);
+    shaderUpsample.setInt("ssaoInput", 4);
+    shaderTemporal.use();
+    shaderTemporal.setInt("ssaoInput", 0);
+    shaderTemporal.setInt("aoHistory", 1);
+    shaderTemporal.setInt("gDepth", 2);
+    shaderDepthMip.use();
+    shaderDepthMip.setInt("gDepth", 0);
+    shaderDepthMip.setInt("depthPyramid", 1);
+    shaderDeinterleave.use();
+    shaderDeinterleave.setInt("gDepth", 0);
+    shaderReinterleave.use();
+    shaderReinterleave.setInt("aoLayers", 0);
+    if (computeAOSupported)
+    {
+        shaderComputeAO->use();
+        shaderComputeAO->setInt("gDepth", 0);
+        shaderComputeAO->setInt("gNormal", 1);
+        shaderComputeAO->setInt("texNoise", 2);
+        shaderComputeAO->bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+        shaderComputeAO->bindUniformBlock("SSAOKernel", UBO_BINDING_SSAO_KERNEL);
+        shaderComputeAO->bindUniformBlock("AOParams", UBO_BINDING_AO_PARAMS);
+    }
+    // The albedo attachment is only kept when the material set samples a texture for it
+    bool materialHasAlbedo = glGetUniformLocation(shaderGeometryPass.ID, "texture_diffuse1") >= 0
+        || glGetUniformLocation(shaderGeometryPass.ID, "texture_specular1") >= 0;
+    shaderGeometryPass.use();
+    shaderGeometryPass.setVec3("constantAlbedo", MaterialAlbedo);
+    shaderGeometryPass.setVec3("positionScale", glm::vec3(1.0f));
+    shaderGeometryPass.setVec3("positionOffset", glm::vec3(0.0f));
+    shaderGeometryInstanced.use();
+    shaderGeometryInstanced.setVec3("constantAlbedo", MaterialAlbedo);
+    shaderGeometryInstanced.setVec3("positionScale", glm::vec3(1.0f));
+    shaderGeometryInstanced.setVec3("positionOffset", glm::vec3(0.0f));
+    shaderDepthPrepass.use();
+    shaderDepthPrepass.setVec3("positionScale", glm::vec3(1.0f));
+    shaderDepthPrepass.setVec3("positionOffset", glm::vec3(0.0f));
+    shaderDepthPrepassInstanced.use();
+    shaderDepthPrepassInstanced.setVec3("positionScale", glm::vec3(1.0f));
+    shaderDepthPrepassInstanced.setVec3("positionOffset", glm::vec3(0.0f));
+    shaderLightingPass.use();
+    shaderLightingPass.setBool("hasAlbedo", materialHasAlbedo);
+    shaderLightingPass.setVec3("constantAlbedo", MaterialAlbedo);
+    // Shared std140 blocks
+    shaderGeometryPass.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+    shaderGeometryInstanced.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+    shaderDepthPrepass.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+    shaderDepthPrepassInstanced.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+    shaderLightingPass.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+    shaderUpsample.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+    shaderTemporal.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+    shaderDepthMip.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+    shaderDeinterleave.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+    UniformBuffer cameraUBO(UBO_BINDING_CAMERA, sizeof(CameraBlock));
+    UniformBuffer ssaoKernelUBO(UBO_BINDING_SSAO_KERNEL, sizeof(SSAOKernelBlock<MAX_KERNEL_SIZE>));
+    UniformBuffer aoParamsUBO(UBO_BINDING_AO_PARAMS, sizeof(AOParamsBlock));
+    int generatedKernelType = -1;
+    bool kernelUploaded = false;
+    // Per-draw uniforms of the geometry pass, resolved once
+    UniformHandle<glm::mat4> geometryModel = shaderGeometryPass.getUniform<glm::mat4>("model");
+    UniformHandle<bool> geometryInvertedNormals = shaderGeometryPass.getUniform<bool>("invertedNormals");
+    const ScenePrograms geometryPrograms = { &shaderGeometryPass, &shaderGeometryInstanced, geometryModel, geometryInvertedNormals,
+        shaderGeometryPass.getUniform<glm::vec3>("positionScale"), shaderGeometryPass.getUniform<glm::vec3>("positionOffset"),
+        shaderGeometryInstanced.getUniform<glm::vec3>("positionScale"), shaderGeometryInstanced.getUniform<glm::vec3>("positionOffset"), false };
+    const ScenePrograms prepassPrograms = { &shaderDepthPrepass, &shaderDepthPrepassInstanced, shaderDepthPrepass.getUniform<glm::mat4>("model"),
+        shaderDepthPrepass.getUniform<bool>("invertedNormals"),
+        shaderDepthPrepass.getUniform<glm::vec3>("positionScale"), shaderDepthPrepass.getUniform<glm::vec3>("positionOffset"),
+        shaderDepthPrepassInstanced.getUniform<glm::vec3>("positionScale"), shaderDepthPrepassInstanced.getUniform<glm::vec3>("positionOffset"), true };
+    UniformHandle<int> depthMipLevel = shaderDepthMip.getUniform<int>("level");
+    UniformHandle<int> deinterleaveFirstLayer = shaderDeinterleave.getUniform<int>("firstLayer");
+    UniformHandle<glm::mat4> temporalViewToPrevView = shaderTemporal.getUniform<glm::mat4>("viewToPrevView");
+    UniformHandle<glm::mat4> temporalPrevProjection = shaderTemporal.getUniform<glm::mat4>("prevProjection");
+    UniformHandle<float> temporalBlendFactor = shaderTemporal.getUniform<float>("blendFactor");
+    UniformHandle<bool> temporalHistoryValid = shaderTemporal.getUniform<bool>("historyValid");
+    UniformHandle<bool> lightingHeatmap = shaderLightingPass.getUniform<bool>("aoHeatmap");
+    UniformHandle<bool> computeEnableBlur;
+    UniformHandle<int> computeBlurMode, computeBlurRadius;
+    if (computeAOSupported)
+    {
+        computeEnableBlur = shaderComputeAO->getUniform<bool>("enableBlur");
+        computeBlurMode = shaderComputeAO->getUniform<int>("blurMode");
+        computeBlurRadius = shaderComputeAO->getUniform<int>("blurRadius");
+    }
 
-    // Load models
-    Model backpack(curDir + "Assets/objects/backpack/backpack.obj");
-    Model teapot(curDir + "Assets/objects/teapot/teapot.obj");
-    Model tiger(curDir + "Assets/objects/tiger/tiger.obj");
-    // Init G-Buffer
-    unsigned int gBuffer;
-    glGenFramebuffers(1, &gBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-    // Position
-    unsigned int gPosition, gNormal, gAlbedo;
-    glGenTextures(1, &gPosition);
-    glBindTexture(GL_TEXTURE_2D, gPosition);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
-    // Normal
-    glGenTextures(1, &gNormal);
-    glBindTexture(GL_TEXTURE_2D, gNormal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
-    // Albedo
-    glGenTextures(1, &gAlbedo);
-    glBindTexture(GL_TEXTURE_2D, gAlbedo);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gAlbedo, 0);
-    // Tell OpenGL which color attachments we'll use (of this framebuffer) for rendering 
-    unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-    glDrawBuffers(3, attachments);
-    // Create and attach depth buffer (renderbuffer)
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-    // Finally check if framebuffer is complete
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // Init SSAO related buffers
-    // Occlusion
-    unsigned int ssaoFBO, ssaoColorBuffer;
-    glGenFramebuffers(1, &ssaoFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
-    glGenTextures(1, &ssaoColorBuffer);
-    glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, SCR_WIDTH, SCR_HEIGHT, 0, GL_RED, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoColorBuffer, 0);
-    // Blur
-    unsigned int ssaoBlurFBO, ssaoColorBufferBlur;
-    glGenFramebuffers(1, &ssaoBlurFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
-    glGenTextures(1, &ssaoColorBufferBlur);
-    glBindTexture(GL_TEXTURE_2D, ssaoColorBufferBlur);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, SCR_WIDTH, SCR_HEIGHT, 0, GL_RED, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoColorBufferBlur, 0);
+    // the setup above has waited for nearly all of them; catch any it did not touch
+    for (const Shader* shader : startupShaders)
+        shader->finish();
+    markStartup("programs linked");
+    std::cout << "Startup timeline (ms, parallel shader compile " << (parallelCompile ? "on" : "unavailable") << "):" << std::endl;
+    for (const TimelineEvent& event : startupTimeline)
+        std::cout << "  " << event.ms << "  " << event.what << std::endl;
+    // Shader time is what the main thread spent on shaders: submitting, then waiting after the models were loaded.
+    // Cold: at least one program was compiled; warm: every program came from the cache.
+    const double shaderStartupMs = submitMs + startupTimeline.back().ms - modelsLoadedMs;
+    const bool warmStart = programCache.GetHits() > 0 && programCache.GetMisses() == 0;
+    std::cout << "Shaders: " << shaderStartupMs << " ms, " << (!programCache.IsEnabled() ? "program cache off (needs GL 4.1)" : warmStart ? "warm" : "cold")
+              << " (" << programCache.GetHits() << " cached, " << programCache.GetMisses() << " compiled)" << std::endl;
+
+    // Instance grids of the teapot and tiger, rebuilt when the model or the grid size changes
+    InstanceBuffer gridInstances;
+    teapot.SetInstanceBuffer(gridInstances);
+    tiger.SetInstanceBuffer(gridInstances);
+    std::vector<InstanceData> gridTransforms;
+    int gridModel = -1, gridSize = 0;
+    int geometryDraws = 0;
+    // Fragments per pixel passing the depth test in the G-buffer pass (shaded into the MRTs) and in the pre-pass
+    OverdrawCounter geometryOverdraw, prepassOverdraw;
+    // Merged copies of the models; a single-instance draw of the backpack goes through the same path
+    GLMultiDrawIndirect multiDrawIndirect;
+    const bool multiDrawSupported = multiDrawIndirect.Load(loadProc);
+    // rebuilt when the vertex format changes
+    std::unique_ptr<GeometryArena> backpackArena, teapotArena, tigerArena;
+    int arenaFormat = -1;
+    auto buildArenas = [&](int format)
+    {
+        auto build = [format, &multiDrawIndirect](const Model& object)
+        {
+            return format == VERTEX_FORMAT_FLOAT ? std::make_unique<GeometryArena>(object.meshes, FloatVertexLayout(), multiDrawIndirect)
+                                                 : std::make_unique<GeometryArena>(object.meshes, QuantizedVertexLayout(), multiDrawIndirect);
+        };
+        backpackArena = build(backpack);
+        teapotArena = build(teapot);
+        tigerArena = build(tiger);
+        teapotArena->SetInstanceBuffer(gridInstances);
+        tigerArena->SetInstanceBuffer(gridInstances);
+        arenaFormat = format;
+    };
+    // the arena's dequantization only applies to its own draw; the room cube and per-mesh draws use float positions
+    auto drawArena = [&](GeometryArena& arena, const ScenePrograms& programs, bool instanced, int instances)
+    {
+        Shader& shader = instanced ? *programs.instanced : *programs.plain;
+        UniformHandle<glm::vec3> scale = instanced ? programs.instancedPositionScale : programs.positionScale;
+        UniformHandle<glm::vec3> offset = instanced ? programs.instancedPositionOffset : programs.positionOffset;
+        shader.set(scale, arena.GetPositionScale());
+        shader.set(offset, arena.GetPositionOffset());
+        int draws = arena.Draw(shader, instances, materialHasAlbedo && !programs.depthOnly, programs.depthOnly);
+        shader.set(scale, glm::vec3(1.0f));
+        shader.set(offset, glm::vec3(0.0f));
+        return draws;
+    };
+    buildArenas(VertexFormat);
+    std::cout << "Merged geometry: " << backpackArena->GetCommandCount() << "/" << teapotArena->GetCommandCount() << "/"
+              << tigerArena->GetCommandCount() << " meshes in " << backpackArena->GetMaterialCount() << "/" << teapotArena->GetMaterialCount() << "/"
+              << tigerArena->GetMaterialCount() << " materials, " << backpackArena->GetLayoutName() << " vertices ("
+              << backpackArena->GetBytesPerVertex() << " B, " << sizeof(Vertex) << " B per mesh vertex), "
+              << (multiDrawSupported ? "glMultiDrawElementsIndirect" : "base-vertex draws (multi-draw indirect needs GL 4.3)") << std::endl;
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // Render targets: every G-buffer, AO and output texture is described from the framebuffer size and the
+    // settings at the start of each frame, and only reallocated when its description changes
+    GLTextureStorage textureStorage;
+    const bool immutableTargets = textureStorage.Load(loadProc);
+    std::cout << "Render targets: " << (immutableTargets ? "immutable glTexStorage" : "mutable glTexImage (glTexStorage needs GL 4.2)")
+              << std::endl;
+    RenderTargets targets(textureStorage, RT_COUNT, FB_COUNT);
+    // Albedo, only when a material samples it; otherwise the lighting pass uses MaterialAlbedo
+    if (materialHasAlbedo)
+        targets.SetAttachments(FB_GBUFFER, { { GL_COLOR_ATTACHMENT0, RT_G_NORMAL }, { GL_COLOR_ATTACHMENT1, RT_G_ALBEDO }, { GL_DEPTH_ATTACHMENT, RT_G_DEPTH } });
+    else
+        targets.SetAttachments(FB_GBUFFER, { { GL_COLOR_ATTACHMENT0, RT_G_NORMAL }, { GL_DEPTH_ATTACHMENT, RT_G_DEPTH } });
+    targets.SetAttachments(FB_AO, { { GL_COLOR_ATTACHMENT0, RT_AO_RAW } });
+    targets.SetAttachments(FB_AO_BLUR_TEMP, { { GL_COLOR_ATTACHMENT0, RT_AO_BLUR_TEMP } });
+    targets.SetAttachments(FB_AO_BLUR, { { GL_COLOR_ATTACHMENT0, RT_AO_BLUR } });
+    targets.SetAttachments(FB_AO_GUIDE, { { GL_COLOR_ATTACHMENT0, RT_AO_DEPTH }, { GL_COLOR_ATTACHMENT1, RT_AO_NORMAL } });
+    targets.SetAttachments(FB_AO_UPSAMPLE, { { GL_COLOR_ATTACHMENT0, RT_AO_UPSAMPLED } });
+    targets.SetAttachments(FB_AO_HISTORY0, { { GL_COLOR_ATTACHMENT0, RT_AO_HISTORY0 } });
+    targets.SetAttachments(FB_AO_HISTORY1, { { GL_COLOR_ATTACHMENT0, RT_AO_HISTORY1 } });
+    targets.SetAttachments(FB_OUTPUT, { { GL_COLOR_ATTACHMENT0, RT_OUTPUT_COLOR }, { GL_DEPTH_ATTACHMENT, RT_OUTPUT_DEPTH } });
+    // FB_DEPTH_PYRAMID and FB_DEINTERLEAVE attach a level or layer per draw
+    constexpr int DEINTERLEAVE_LAYERS = 16;
+    const unsigned int deinterleaveAttachments[8] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3,
+                                                     GL_COLOR_ATTACHMENT4, GL_COLOR_ATTACHMENT5, GL_COLOR_ATTACHMENT6, GL_COLOR_ATTACHMENT7 };
+    int aoHistoryIndex = 0;
+    bool aoHistoryValid = false;
 
-    // Init SSAO sample kernel and noise
-    // SSAO kernel
-    auto lerp = [](float a, float b, float f) -> float
+    // Size of the G-buffer and the AO passes: the output size times RenderScale
+    int renderWidth = screenWidth, renderHeight = screenHeight;
+
+    // Sizes and formats for the current render size, AO scale, G-buffer profile and passes; the targets of
+    // passes that are switched off get no storage
+    auto describeTargets = [&](bool computeAO)
     {
-        return a + f * (b - a);
+        const GBufferLayout& layout = GetGBufferLayout(GBufferProfile);
+        const int width = renderWidth, height = renderHeight;
+        const int aoWidth = std::max(1, width / AOResolutionScale), aoHeight = std::max(1, height / AOResolutionScale);
+        const TextureDesc none;
+        targets.Describe(RT_G_NORMAL, TextureDesc::Texture2D(layout.normalFormat, width, height));
+        targets.Describe(RT_G_ALBEDO, materialHasAlbedo ? TextureDesc::Texture2D(GL_RGBA8, width, height) : none);
+        // Sampleable depth: later passes reconstruct view space positions from it and the inverse projection
+        targets.Describe(RT_G_DEPTH, TextureDesc::Texture2D(GL_DEPTH_COMPONENT32F, width, height, GL_CLAMP_TO_EDGE));
+        // r: AO, g: linear depth, ba: octahedral normal; the compute path writes the blurred AO directly
+        targets.Describe(RT_AO_RAW, computeAO ? none : TextureDesc::Texture2D(GL_RGBA16F, aoWidth, aoHeight));
+        // Bilateral blur ping-pong target (horizontal pass output)
+        targets.Describe(RT_AO_BLUR_TEMP, !computeAO && SSAOBlurMode == 1 ? TextureDesc::Texture2D(GL_RGBA16F, aoWidth, aoHeight) : none);
+        // the blurred AO is only read for its r channel
+        targets.Describe(RT_AO_BLUR, TextureDesc::Texture2D(layout.aoFormat, aoWidth, aoHeight));
+        // Reduced resolution AO: depth/normal guides for the occlusion pass, and the upsampled full resolution result
+        const bool reduced = AOResolutionScale > 1;
+        targets.Describe(RT_AO_DEPTH, reduced ? TextureDesc::Texture2D(GL_R32F, aoWidth, aoHeight, GL_CLAMP_TO_EDGE) : none);
+        targets.Describe(RT_AO_NORMAL, reduced ? TextureDesc::Texture2D(layout.normalFormat, aoWidth, aoHeight) : none);
+        targets.Describe(RT_AO_UPSAMPLED, reduced ? TextureDesc::Texture2D(layout.aoFormat, width, height) : none);
+        // Temporal AO history, ping-ponged: one is read as the previous frame while the other is written
+        for (int i = 0; i < 2; ++i)
+            targets.Describe(RT_AO_HISTORY0 + i, SSAOTemporal ? TextureDesc::Texture2D(GL_RGBA16F, aoWidth, aoHeight) : none);
+        // Linear depth pyramid at AO resolution, as many levels up to MAX_DEPTH_MIP as the size allows
+        int pyramidLevels = 1;
+        while (pyramidLevels <= MAX_DEPTH_MIP && std::max(aoWidth, aoHeight) >> pyramidLevels > 0)
+            ++pyramidLevels;
+        targets.Describe(RT_DEPTH_PYRAMID, AODepthMips && !AODeinterleaved
+            ? TextureDesc::Texture2D(GL_R32F, aoWidth, aoHeight, GL_CLAMP_TO_EDGE, GL_NEAREST_MIPMAP_NEAREST, pyramidLevels) : none);
+        // Deinterleaved AO: 16 quarter resolution layers of linear depth in, per-layer occlusion out
+        const int layerWidth = (aoWidth + 3) / 4, layerHeight = (aoHeight + 3) / 4;
+        targets.Describe(RT_DEINTERLEAVED_DEPTH, AODeinterleaved ? TextureDesc::Array(GL_R32F, layerWidth, layerHeight, DEINTERLEAVE_LAYERS) : none);
+        targets.Describe(RT_DEINTERLEAVED_AO, AODeinterleaved ? TextureDesc::Array(GL_RGBA16F, layerWidth, layerHeight, DEINTERLEAVE_LAYERS) : none);
+        // Output target: the default framebuffer, or an offscreen one when there is no window
+        targets.Describe(RT_OUTPUT_COLOR, HeadlessMode ? TextureDesc::Texture2D(GL_RGBA8, screenWidth, screenHeight) : none);
+        targets.Describe(RT_OUTPUT_DEPTH, HeadlessMode ? TextureDesc::Texture2D(GL_DEPTH_COMPONENT24, screenWidth, screenHeight) : none);
     };
-    for (int i = 0; i < MAX_KERNEL_SIZE; ++i)
+
+    // Points the shaders at the normal encoding of a G-buffer profile; the formats follow in describeTargets
+    int appliedGBufferProfile = -1;
+    auto applyGBufferProfile = [&](int profile)
     {
-        float hbaoZ = randomFloats(generator);
-        float ssaoZ = randomFloats(generator) * 2 - 1.f;
-        glm::vec3 sample = glm::vec3(
-            randomFloats(generator) * 2 - 1.f,
-            randomFloats(generator) * 2 - 1.f,
-            randomFloats(generator) * 2 - 1.f
-        );
-        sample = glm::normalize(sample);
-        sample *= randomFloats(generator);
-        float scale = (float)i / (float)MAX_KERNEL_SIZE;
-        scale = lerp(0.1f, 1.0f, scale * scale);
-        sample *= scale;
-        ssaoKernel.push_back(sample);
-
-        sample = glm::vec3(
-            randomFloats(generator) * 2 - 1.f,
-            randomFloats(generator) * 2 - 1.f,
-            randomFloats(generator)
-        );
-        sample = glm::normalize(sample);
-        sample *= randomFloats(generator);
-        sample *= scale;
-        hbaoKernel.push_back(sample);
-    }
+        const GBufferLayout& layout = GetGBufferLayout(profile);
+        shaderGeometryPass.use();
+        shaderGeometryPass.setBool("octahedralNormals", layout.octahedralNormals);
+        shaderGeometryInstanced.use();
+        shaderGeometryInstanced.setBool("octahedralNormals", layout.octahedralNormals);
+        occlusionShaders.ForEach([&](ShaderPermutations<OcclusionUniforms>::Variant& variant)
+        {
+            variant.shader->use();
+            variant.shader->setBool("octahedralNormals", layout.octahedralNormals);
+        });
+        if (shaderComputeAO)
+        {
+            shaderComputeAO->use();
+            shaderComputeAO->setBool("octahedralNormals", layout.octahedralNormals);
+        }
+        shaderUpsample.use();
+        shaderUpsample.setBool("octahedralNormals", layout.octahedralNormals);
+        shaderLightingPass.use();
+        shaderLightingPass.setBool("octahedralNormals", layout.octahedralNormals);
+        appliedGBufferProfile = profile;
+    };
+    const unsigned int outputFBO = HeadlessMode ? targets.Framebuffer(FB_OUTPUT) : 0;
+    // Bilinear reads of albedo and AO for the lighting pass while it upscales; depth and normals stay nearest so
+    // the lighting never blends across silhouettes
+    unsigned int upscaleSampler;
+    glGenSamplers(1, &upscaleSampler);
+    glSamplerParameteri(upscaleSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(upscaleSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(upscaleSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(upscaleSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Init SSAO noise; the kernel is generated in the frame loop whenever its distribution or size changes
     for (int i = 0; i < NOISE_TEXTURE_SIZE * NOISE_TEXTURE_SIZE; ++i)
     {
         glm::vec3 noise = glm::vec3(
@@ -241,146 +715,508 @@ int main(int argc, char* argv[])
     // Light
     glm::vec3 lightPos = glm::vec3(2.0, 4.0, -2.0);
     glm::vec3 lightColor = glm::vec3(1.0, 1.0, 1.0);
+    // Constant light uniforms; the shader moves the position to view space with the Camera block
+    const float linear = 0.09f;
+    const float quadratic = 0.032f;
+    shaderLightingPass.use();
+    shaderLightingPass.setVec3("light.Position", lightPos);
+    shaderLightingPass.setVec3("light.Color", lightColor);
+    shaderLightingPass.setFloat("light.Linear", linear);
+    shaderLightingPass.setFloat("light.Quadratic", quadratic);
 
-    while (!glfwWindowShouldClose(window))
+    GpuTimer gpuTimer({ "S1 Depth Pre-pass", "S1 Geometry", "S2 Downsample", "S2 Depth Mips", "S2 Deinterleave", "S2 Occlusion", "S2 Compute", "S2 Reinterleave", "S2 Temporal", "S3 Blur", "S3 Upsample", "S4 Lighting" });
+    if (RecordTimingCsv)
+        RecordTimingCsv = gpuTimer.OpenCsv(TimingCsvPath);
+
+    unsigned int aoResult = 0; // AO texture the lighting pass reads
+    glm::mat4 prevView = glm::mat4(1.0f), prevProjection = glm::mat4(1.0f);
+    int temporalFrame = 0;
+    float occlusionPathMs[2] = { 0.0f, 0.0f }; // last measured occlusion + blur cost of each OcclusionPath
+    DynamicResolution resolution;
+    resolution.Reset(RenderScale);
+    bool resolutionWasDynamic = DynamicResolutionEnabled;
+    long long resolutionSamples = 0; // GPU timer frames already fed to the controller
+    int frameIndex = 0;
+    auto runStart = std::chrono::steady_clock::now();
+    while (HeadlessMode ? frameIndex < HeadlessFrames : !glfwWindowShouldClose(window))
     {
-        float currentTime = (float)glfwGetTime();
-        deltaTime = currentTime - lastFrame;
-        lastFrame = currentTime;
-        processContinuousInput(window);
+        if (!HeadlessMode)
+        {
+            float currentTime = (float)glfwGetTime();
+            deltaTime = currentTime - lastFrame;
+            lastFrame = currentTime;
+            processContinuousInput(window);
+        }
+        gpuTimer.BeginFrame();
+        float fragmentPathMs = gpuTimer.GetLast(PASS_OCCLUSION) + gpuTimer.GetLast(PASS_BLUR);
+        if (fragmentPathMs > 0.0f)
+            occlusionPathMs[OCCLUSION_FRAGMENT] = fragmentPathMs;
+        if (gpuTimer.GetLast(PASS_COMPUTE_AO) > 0.0f)
+            occlusionPathMs[OCCLUSION_COMPUTE] = gpuTimer.GetLast(PASS_COMPUTE_AO);
+        // Render scale from the newest complete GPU frame
+        if (DynamicResolutionEnabled && !resolutionWasDynamic)
+            resolution.Reset(RenderScale);
+        resolutionWasDynamic = DynamicResolutionEnabled;
+        if (DynamicResolutionEnabled && gpuTimer.GetSampleCount() != resolutionSamples)
+        {
+            float gpuMs = 0.0f;
+            for (int pass = 0; pass < PASS_COUNT; ++pass)
+                gpuMs += gpuTimer.GetLast(pass);
+            resolution.budgetMs = FrameBudgetMs;
+            RenderScale = resolution.Update(gpuMs);
+        }
+        resolutionSamples = gpuTimer.GetSampleCount();
+        renderWidth = std::max(1, (int)std::lround(screenWidth * RenderScale));
+        renderHeight = std::max(1, (int)std::lround(screenHeight * RenderScale));
+        // the heatmap shows raw per-pixel tap counts
+        const bool blurAO = SSAOEnableBlur && !AOHeatmap;
+        // the compute path has no temporal history, layer or pyramid input
+        const bool computeAO = AOPath == OCCLUSION_COMPUTE && !SSAOTemporal && !AODeinterleaved && !AODepthMips;
+        // Resize or reformat the targets whose description changed since the last frame
+        describeTargets(computeAO);
+        targets.Update(frameIndex);
+        if (targets.Changed(RT_AO_HISTORY0) || targets.Changed(RT_AO_HISTORY1))
+            aoHistoryValid = false;
+        if (GBufferProfile != appliedGBufferProfile)
+            applyGBufferProfile(GBufferProfile);
+        const unsigned int gDepth = targets.Get(RT_G_DEPTH), gNormal = targets.Get(RT_G_NORMAL), gAlbedo = targets.Get(RT_G_ALBEDO);
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // SSAO S1: Geometry pass
-        // Render scene's geometry/color data into G-Buffer
-        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 50.0f);
+        if (arenaFormat != VertexFormat)
+            buildArenas(VertexFormat);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)screenWidth / (float)screenHeight, 0.1f, 50.0f);
         glm::mat4 view = camera.GetViewMatrix();
         glm::mat4 model = glm::mat4(1.0f);
-        shaderGeometryPass.use();
-        shaderGeometryPass.setMat4("projection", projection);
-        shaderGeometryPass.setMat4("view", view);
-        // Room cube
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0, 7.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(7.5f, 7.5f, 7.5f));
-        shaderGeometryPass.setMat4("model", model);
-        shaderGeometryPass.setInt("invertedNormals", 1); // invert normals as we're inside the cube
-        renderCube();
-        shaderGeometryPass.setInt("invertedNormals", 0);
-        switch (ModelObj)
-        {
-        case 0:
-            // Backpack model on the floor
+        CameraBlock cameraBlock = { projection, view, glm::inverse(projection) };
+        cameraUBO.Update(cameraBlock);
+        if ((ModelObj == 1 || ModelObj == 2) && (gridModel != ModelObj || gridSize != InstanceGridSize))
+        {
+            model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.5f, 0.0));
+            if (ModelObj == 1)
+            {
+                model = glm::rotate(model, glm::radians(30.0f), glm::vec3(0.0, 1.0, 0.0));
+                model = glm::scale(model, glm::vec3(0.2f));
+            }
+            else
+            {
+                model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0, 0.0, 1.0));
+                model = glm::scale(model, glm::vec3(0.05f));
+            }
+            gridTransforms = InstanceBuffer::Grid(InstanceGridSize, 0.8f, model);
+            gridInstances.Update(gridTransforms);
+            gridModel = ModelObj;
+            gridSize = InstanceGridSize;
+        }
+        // Draws the room and the selected model with one set of programs; returns the number of draw calls
+        auto drawScene = [&](const ScenePrograms& programs)
+        {
+            Shader& shader = *programs.plain;
+            shader.use();
+            // Room cube
             model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(0.0f, 0.5f, 0.0));
-            model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
-            model = glm::scale(model, glm::vec3(1.0f));
-            shaderGeometryPass.setMat4("model", model);
-            backpack.Draw(shaderGeometryPass);
-            break;
-        case 1:
-            // Teapot model
-            for(int i = -3; i<=3; ++i)
+            model = glm::translate(model, glm::vec3(0.0, 7.0f, 0.0f));
+            model = glm::scale(model, glm::vec3(7.5f, 7.5f, 7.5f));
+            shader.set(programs.model, model);
+            shader.set(programs.invertedNormals, true); // invert normals as we're inside the cube
+            renderCube();
+            shader.set(programs.invertedNormals, false);
+            int draws = 1;
+            if (ModelObj == 0)
             {
-                for (int j = -3; j<=3; ++j)
+                // Backpack model on the floor
+                model = glm::mat4(1.0f);
+                model = glm::translate(model, glm::vec3(0.0f, 0.5f, 0.0));
+                model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
+                model = glm::scale(model, glm::vec3(1.0f));
+                shader.set(programs.model, model);
+                if (MergedGeometry)
+                {
+                    draws += drawArena(*backpackArena, programs, false, 1);
+                }
+                else
                 {
-                    model = glm::mat4(1.0f);
-                    model = glm::translate(model, glm::vec3(i*0.8f, 0.f, j*0.8f));
-                    model = glm::translate(model, glm::vec3(0.0f, -0.5f, 0.0));
-                    model = glm::rotate(model, glm::radians(30.0f), glm::vec3(0.0, 1.0, 0.0));
-                    model = glm::scale(model, glm::vec3(0.2f));
-                    shaderGeometryPass.setMat4("model", model);
-                    teapot.Draw(shaderGeometryPass);
+                    backpack.Draw(shader);
+                    draws += (int)backpack.meshes.size();
                 }
             }
-            break;
-        case 2:
-            for (int i = -3; i <= 3; ++i)
+            else if (ModelObj == 1 || ModelObj == 2)
             {
-                for (int j = -3; j <= 3; ++j)
+                // Teapot or tiger grid
+                Model& gridObject = ModelObj == 1 ? teapot : tiger;
+                GeometryArena& gridArena = ModelObj == 1 ? *teapotArena : *tigerArena;
+                if (InstancedDraw && MergedGeometry)
                 {
-                    model = glm::mat4(1.0f);
-                    model = glm::translate(model, glm::vec3(i * 0.8f, 0.f, j * 0.8f));
-                    model = glm::translate(model, glm::vec3(0.0f, -0.5f, 0.0));
-                    model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0, 0.0, 1.0));
-                    model = glm::scale(model, glm::vec3(0.05f));
-                    shaderGeometryPass.setMat4("model", model);
-                    tiger.Draw(shaderGeometryPass);
+                    programs.instanced->use();
+                    draws += drawArena(gridArena, programs, true, gridInstances.GetCount());
+                }
+                else if (InstancedDraw)
+                {
+                    programs.instanced->use();
+                    gridObject.DrawInstanced(*programs.instanced, gridInstances.GetCount());
+                    draws += (int)gridObject.meshes.size();
+                }
+                else
+                {
+                    for (const InstanceData& instance : gridTransforms)
+                    {
+                        shader.set(programs.model, instance.model);
+                        gridObject.Draw(shader);
+                    }
+                    draws += (int)(gridTransforms.size() * gridObject.meshes.size());
                 }
             }
-            break;
-            break;
-        default:
-            break;
+            return draws;
+        };
+        glBindFramebuffer(GL_FRAMEBUFFER, targets.Framebuffer(FB_GBUFFER));
+        glViewport(0, 0, renderWidth, renderHeight);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        geometryDraws = 0;
+        if (DepthPrepass)
+        {
+            // Depth only; counts the fragments that pass the depth test, i.e. what the G-buffer pass would shade
+            // without it
+            gpuTimer.Begin(PASS_DEPTH_PREPASS);
+            prepassOverdraw.Begin(renderWidth * renderHeight);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            geometryDraws += drawScene(prepassPrograms);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            prepassOverdraw.End();
+            gpuTimer.End();
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
         }
+        // Render scene's geometry/color data into G-Buffer
+        gpuTimer.Begin(PASS_GEOMETRY);
+        geometryOverdraw.Begin(renderWidth * renderHeight);
+        geometryDraws += drawScene(geometryPrograms);
+        geometryOverdraw.End();
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        gpuTimer.End();
+
+        const int aoWidth = targets.GetDesc(RT_AO_BLUR).width, aoHeight = targets.GetDesc(RT_AO_BLUR).height;
+        // Occlusion inputs: the G-buffer itself, or its reduced resolution guides
+        unsigned int aoInputDepth = gDepth, aoInputNormal = gNormal;
+        glViewport(0, 0, aoWidth, aoHeight);
+        if (AOResolutionScale > 1)
+        {
+            // SSAO S2: Downsample depth and normals (checkerboard min/max)
+            gpuTimer.Begin(PASS_DOWNSAMPLE);
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.Framebuffer(FB_AO_GUIDE));
+            shaderDownsample.use();
+            shaderDownsample.set1i("scale", AOResolutionScale);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, gDepth);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, gNormal);
+            renderQuad();
+            gpuTimer.End();
+            aoInputDepth = targets.Get(RT_AO_DEPTH);
+            aoInputNormal = targets.Get(RT_AO_NORMAL);
+        }
 
         // SSAO S2: Sample and generate occlusion
-        glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
-        glClear(GL_COLOR_BUFFER_BIT);
-        shaderOcclusion.use();
-        // Send kernel + rotation
-        shaderOcclusion.set1i("aoMethod", AOMethod);
-        shaderOcclusion.set1i("kernelSize", ssaoKernelSize);
-        shaderOcclusion.set1f("radius", SSAORadius);
-        shaderOcclusion.set1b("rangeCheck", SSAORangeCheck);
-        shaderOcclusion.set1f("ssaoPower", SSAOPower);
-        
-        if (AOMethod == 1)
-        {
-            for (unsigned int i = 0; i < ssaoKernelSize; ++i)
-                shaderOcclusion.setVec3("samples[" + std::to_string(i) + "]", ssaoKernel[i]);
+        // Send kernel + rotation; the kernel is regenerated when its distribution or size changed and only goes
+        // over the bus when SSAO needs it
+        // Temporal mode turns the noise by the golden angle and walks interleaved kernel subsets every frame,
+        // so consecutive frames sample different directions and the history converges to the full kernel
+        if (!SSAOTemporal)
+            aoHistoryValid = false;
+        int kernelStride = SSAOTemporal ? std::max(1, MAX_KERNEL_SIZE / ssaoKernelSize) : 1;
+        int kernelPhase = SSAOTemporal ? temporalFrame % kernelStride : 0;
+        float noiseRotation = SSAOTemporal ? std::fmod(temporalFrame * 2.39996323f, 6.28318531f) : 0.0f;
+        // the pyramid only has storage while depth mips are on
+        const int depthMaxLevel = targets.GetDesc(RT_DEPTH_PYRAMID).levels - 1;
+        AOParamsBlock aoParams{};
+        aoParams.aoMethod = AOMethod;
+        aoParams.kernelSize = ssaoKernelSize;
+        aoParams.radius = SSAORadius;
+        aoParams.rangeCheck = SSAORangeCheck ? 1 : 0;
+        aoParams.ssaoPower = SSAOPower;
+        aoParams.hbaoDirections = HBAODirections;
+        aoParams.hbaoSteps = HBAOSteps;
+        aoParams.noiseRotation = noiseRotation;
+        aoParams.kernelStride = kernelStride;
+        aoParams.kernelPhase = kernelPhase;
+        aoParams.depthMaxLevel = depthMaxLevel;
+        aoParams.adaptiveSamples = AOAdaptive ? 1 : 0;
+        aoParams.adaptiveFullRadius = AdaptiveFullRadius;
+        aoParams.adaptiveFalloffDepth = AdaptiveFalloffDepth;
+        aoParams.adaptiveTolerance = AdaptiveTolerance;
+        aoParams.aoHeatmap = AOHeatmap ? 1 : 0;
+        aoParams.kernelHemisphere = IsHemisphereKernel(KernelType) ? 1 : 0;
+        aoParamsUBO.Update(aoParams);
+        if (KernelType != generatedKernelType || (int)ssaoKernel.size() != (SSAOTemporal ? MAX_KERNEL_SIZE : ssaoKernelSize))
+        {
+            UpdateSSAOKernel();
+            generatedKernelType = KernelType;
+            kernelUploaded = false;
+        }
+        // HBAO marches the depth buffer and needs no kernel
+        if (AOMethod == 1 && !kernelUploaded)
+        {
+            SSAOKernelBlock<MAX_KERNEL_SIZE> kernelBlock;
+            for (size_t i = 0; i < ssaoKernel.size(); ++i)
+                kernelBlock.samples[i] = glm::vec4(ssaoKernel[i], 0.0f);
+            ssaoKernelUBO.Update(&kernelBlock, ssaoKernel.size() * sizeof(glm::vec4));
+            kernelUploaded = true;
+        }
+        if (AODepthMips && !AODeinterleaved)
+        {
+            // SSAO S2: Linear depth pyramid, level 0 from the positions and every other level from the one below
+            gpuTimer.Begin(PASS_DEPTH_MIPS);
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.Framebuffer(FB_DEPTH_PYRAMID));
+            shaderDepthMip.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, aoInputDepth);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            const unsigned int depthPyramid = targets.Get(RT_DEPTH_PYRAMID);
+            for (int level = 0; level <= depthMaxLevel; ++level)
+            {
+                if (level > 0)
+                {
+                    // only the source level stays visible to the sampler, so reading and writing never overlap
+                    glBindTexture(GL_TEXTURE_2D, depthPyramid);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+                }
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, depthPyramid, level);
+                glViewport(0, 0, std::max(1, aoWidth >> level), std::max(1, aoHeight >> level));
+                shaderDepthMip.set(depthMipLevel, level);
+                renderQuad();
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, depthMaxLevel);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, aoWidth, aoHeight);
+            gpuTimer.End();
+        }
+        if (computeAO)
+        {
+            // SSAO S2+S3: Occlusion and blur in one dispatch per 32x32 tile, straight into the blurred target
+            gpuTimer.Begin(PASS_COMPUTE_AO);
+            shaderComputeAO->use();
+            shaderComputeAO->set(computeEnableBlur, blurAO);
+            shaderComputeAO->set(computeBlurMode, SSAOBlurMode);
+            shaderComputeAO->set(computeBlurRadius, SSAOBlurRadius);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, aoInputDepth);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, aoInputNormal);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, ssaoNoiseTex);
+            glCompute.bindImageTexture(0, targets.Get(RT_AO_BLUR), 0, GL_FALSE, 0, GL_WRITE_ONLY, targets.GetDesc(RT_AO_BLUR).internalFormat);
+            glCompute.dispatchCompute((aoWidth + COMPUTE_AO_TILE - 1) / COMPUTE_AO_TILE, (aoHeight + COMPUTE_AO_TILE - 1) / COMPUTE_AO_TILE, 1);
+            // later passes sample the result and the CPU reference reads it back
+            glCompute.memoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+            gpuTimer.End();
+        }
+        else if (AODeinterleaved)
+        {
+            // SSAO S2: Split linear depth into 16 quarter resolution layers, 8 of them per draw
+            gpuTimer.Begin(PASS_DEINTERLEAVE);
+            glViewport(0, 0, (aoWidth + 3) / 4, (aoHeight + 3) / 4);
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.Framebuffer(FB_DEINTERLEAVE));
+            shaderDeinterleave.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, aoInputDepth);
+            for (int firstLayer = 0; firstLayer < DEINTERLEAVE_LAYERS; firstLayer += 8)
+            {
+                for (int i = 0; i < 8; ++i)
+                    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, targets.Get(RT_DEINTERLEAVED_DEPTH), 0, firstLayer + i);
+                glDrawBuffers(8, deinterleaveAttachments);
+                shaderDeinterleave.set(deinterleaveFirstLayer, firstLayer);
+                renderQuad();
+            }
+            gpuTimer.End();
+
+            // One draw per layer, each with a constant noise rotation and all taps inside that layer
+            gpuTimer.Begin(PASS_OCCLUSION);
+            for (int i = 1; i < 8; ++i)
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, 0, 0, 0);
+            glDrawBuffers(1, deinterleaveAttachments);
+            auto& occlusion = occlusionShaders.Get(GetOcclusionDefines());
+            Shader& shaderOcclusion = *occlusion.shader;
+            shaderOcclusion.use();
+            shaderOcclusion.set(occlusion.uniforms.deinterleaved, true);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, aoInputNormal);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, ssaoNoiseTex);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, targets.Get(RT_DEINTERLEAVED_DEPTH));
+            for (int layer = 0; layer < DEINTERLEAVE_LAYERS; ++layer)
+            {
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, targets.Get(RT_DEINTERLEAVED_AO), 0, layer);
+                shaderOcclusion.set(occlusion.uniforms.layer, layer);
+                renderQuad();
+            }
+            gpuTimer.End();
+
+            // SSAO S2: Put the layers back into the AO resolution buffer
+            gpuTimer.Begin(PASS_REINTERLEAVE);
+            glViewport(0, 0, aoWidth, aoHeight);
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.Framebuffer(FB_AO));
+            shaderReinterleave.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, targets.Get(RT_DEINTERLEAVED_AO));
+            renderQuad();
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            gpuTimer.End();
         }
         else
         {
-            for (unsigned int i = 0; i < ssaoKernelSize; ++i)
-                shaderOcclusion.setVec3("samples[" + std::to_string(i) + "]", hbaoKernel[i]);
+            gpuTimer.Begin(PASS_OCCLUSION);
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.Framebuffer(FB_AO));
+            glClear(GL_COLOR_BUFFER_BIT);
+            auto& occlusion = occlusionShaders.Get(GetOcclusionDefines());
+            Shader& shaderOcclusion = *occlusion.shader;
+            shaderOcclusion.use();
+            shaderOcclusion.set(occlusion.uniforms.deinterleaved, false);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, aoInputDepth);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, aoInputNormal);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, ssaoNoiseTex);
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_2D, targets.Get(RT_DEPTH_PYRAMID));
+            renderQuad();
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            gpuTimer.End();
         }
-        shaderOcclusion.setMat4("projection", projection);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gPosition);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, gNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, ssaoNoiseTex);
-        renderQuad();
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-        // SSAO S3: Blur
-        glBindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
-        glClear(GL_COLOR_BUFFER_BIT);
-        shaderBlur.use();
-        shaderBlur.set1b("EnableBlur", SSAOEnableBlur);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
-        renderQuad();
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        unsigned int aoRaw = targets.Get(RT_AO_RAW); // unfiltered AO the blur reads
+        if (SSAOTemporal)
+        {
+            // SSAO S2: Reproject last frame's AO and blend this frame in
+            gpuTimer.Begin(PASS_TEMPORAL);
+            int target = 1 - aoHistoryIndex;
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.Framebuffer(FB_AO_HISTORY0 + target));
+            shaderTemporal.use();
+            shaderTemporal.set(temporalViewToPrevView, prevView * glm::inverse(view));
+            shaderTemporal.set(temporalPrevProjection, prevProjection);
+            shaderTemporal.set(temporalBlendFactor, TemporalBlend);
+            shaderTemporal.set(temporalHistoryValid, aoHistoryValid);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, targets.Get(RT_AO_RAW));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, targets.Get(RT_AO_HISTORY0 + aoHistoryIndex));
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, aoInputDepth);
+            renderQuad();
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            gpuTimer.End();
+            aoHistoryIndex = target;
+            aoHistoryValid = true;
+            aoRaw = targets.Get(RT_AO_HISTORY0 + target);
+            ++temporalFrame;
+        }
+        prevView = view;
+        prevProjection = projection;
+
+        unsigned int aoBlurred = targets.Get(RT_AO_BLUR);
+        if (!computeAO)
+        {
+            // SSAO S3: Blur
+            gpuTimer.Begin(PASS_BLUR);
+            if (SSAOBlurMode == 0)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, targets.Framebuffer(FB_AO_BLUR));
+                glClear(GL_COLOR_BUFFER_BIT);
+                shaderBlur.use();
+                shaderBlur.set1b("EnableBlur", blurAO);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, aoRaw);
+                renderQuad();
+            }
+            else if (blurAO)
+            {
+                // Separable bilateral: horizontal into the ping-pong target, then vertical into the blur target
+                shaderBilateralBlur.use();
+                shaderBilateralBlur.set1i("blurRadius", SSAOBlurRadius);
+                glActiveTexture(GL_TEXTURE0);
+                glBindFramebuffer(GL_FRAMEBUFFER, targets.Framebuffer(FB_AO_BLUR_TEMP));
+                shaderBilateralBlur.set2i("direction", 1, 0);
+                glBindTexture(GL_TEXTURE_2D, aoRaw);
+                renderQuad();
+                glBindFramebuffer(GL_FRAMEBUFFER, targets.Framebuffer(FB_AO_BLUR));
+                shaderBilateralBlur.set2i("direction", 0, 1);
+                glBindTexture(GL_TEXTURE_2D, targets.Get(RT_AO_BLUR_TEMP));
+                renderQuad();
+            }
+            else
+            {
+                aoBlurred = aoRaw;
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            gpuTimer.End();
+        }
+        glViewport(0, 0, renderWidth, renderHeight);
+
+        aoResult = aoBlurred;
+        if (AOResolutionScale > 1)
+        {
+            // SSAO S3: Joint bilateral upsample guided by the full resolution G-buffer
+            gpuTimer.Begin(PASS_UPSAMPLE);
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.Framebuffer(FB_AO_UPSAMPLE));
+            shaderUpsample.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, gDepth);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, gNormal);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, targets.Get(RT_AO_DEPTH));
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, targets.Get(RT_AO_NORMAL));
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_2D, aoBlurred);
+            renderQuad();
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            gpuTimer.End();
+            aoResult = targets.Get(RT_AO_UPSAMPLED);
+        }
 
         // SSAO S4: Light pass
         // Traditional deferred Blinn-Phong lighting with added screen-space ambient occlusion
+        // at the output size, so below a render scale of 1 this is also the upscale
+        gpuTimer.Begin(PASS_LIGHTING);
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+        glViewport(0, 0, screenWidth, screenHeight);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        const bool upscale = renderWidth != screenWidth || renderHeight != screenHeight;
+        if (upscale)
+        {
+            glBindSampler(2, upscaleSampler);
+            glBindSampler(3, upscaleSampler);
+        }
         shaderLightingPass.use();
-        // Send light relevant uniforms
-        glm::vec3 lightPosView = glm::vec3(camera.GetViewMatrix() * glm::vec4(lightPos, 1.0));
-        shaderLightingPass.setVec3("light.Position", lightPosView);
-        shaderLightingPass.setVec3("light.Color", lightColor);
-        // Update attenuation parameters
-        const float linear = 0.09f;
-        const float quadratic = 0.032f;
-        shaderLightingPass.setFloat("light.Linear", linear);
-        shaderLightingPass.setFloat("light.Quadratic", quadratic);
+        shaderLightingPass.set(lightingHeatmap, AOHeatmap);
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gPosition);
+        glBindTexture(GL_TEXTURE_2D, gDepth);
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, gNormal);
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_2D, gAlbedo);
         // Add extra SSAO texture to lighting pass
         glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, ssaoColorBufferBlur);
+        glBindTexture(GL_TEXTURE_2D, aoResult);
         renderQuad();
+        if (upscale)
+        {
+            glBindSampler(2, 0);
+            glBindSampler(3, 0);
+        }
+        gpuTimer.End();
+
+        ++frameIndex;
+        if (HeadlessMode)
+            continue;
 
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -394,18 +1230,124 @@ int main(int argc, char* argv[])
         ImGui::RadioButton("Backpack", &ModelObj, 0); ImGui::SameLine();
         ImGui::RadioButton("Teapot", &ModelObj, 1); ImGui::SameLine();
         ImGui::RadioButton("Tiger", &ModelObj, 2);
+        if (ModelObj != 0)
+        {
+            ImGui::SliderInt("Grid Size", &InstanceGridSize, 1, 64); ImGui::SameLine();
+            ImGui::Checkbox("Instanced", &InstancedDraw);
+        }
+        // The pre-pass pays for itself once the pre-pass + geometry time drops below the geometry time without it,
+        // which takes depth-test overdraw well above 1
+        ImGui::Checkbox("Depth Pre-pass", &DepthPrepass); ImGui::SameLine();
+        if (DepthPrepass)
+            ImGui::Text("Overdraw %.2fx, G-buffer shades %.2fx; %.2f + %.2f ms", prepassOverdraw.GetOverdraw(), geometryOverdraw.GetOverdraw(),
+                gpuTimer.GetAvg(PASS_DEPTH_PREPASS), gpuTimer.GetAvg(PASS_GEOMETRY));
+        else
+            ImGui::Text("Overdraw %.2fx; %.2f ms", geometryOverdraw.GetOverdraw(), gpuTimer.GetAvg(PASS_GEOMETRY));
+        ImGui::Checkbox("Merged Geometry", &MergedGeometry); ImGui::SameLine();
+        ImGui::Text("Geometry draws: %d (%s)", geometryDraws, multiDrawSupported ? "multi-draw indirect" : "base-vertex draws");
+        if (MergedGeometry)
+        {
+            ImGui::Text("Vertex Format: "); ImGui::SameLine();
+            ImGui::RadioButton("Float", &VertexFormat, VERTEX_FORMAT_FLOAT); ImGui::SameLine();
+            ImGui::RadioButton("Quantized", &VertexFormat, VERTEX_FORMAT_QUANTIZED); ImGui::SameLine();
+            ImGui::Text("%d B/vertex (mesh path %d B)", backpackArena->GetBytesPerVertex(), (int)sizeof(Vertex));
+        }
         ImGui::Text("AO Method: "); ImGui::SameLine();
         ImGui::RadioButton("None", &AOMethod, 0);
         ImGui::SameLine();
         ImGui::RadioButton("SSAO", &AOMethod, 1);
         ImGui::SameLine();
         ImGui::RadioButton("HBAO", &AOMethod, 2);
+        ImGui::SameLine();
+        ImGui::Checkbox("Deinterleaved", &AODeinterleaved);
+        ImGui::SameLine();
+        ImGui::Checkbox("Depth Mips", &AODepthMips);
+        ImGui::Text("AO Resolution: "); ImGui::SameLine();
+        ImGui::RadioButton("Full", &AOResolutionScale, 1); ImGui::SameLine();
+        ImGui::RadioButton("1/2", &AOResolutionScale, 2); ImGui::SameLine();
+        ImGui::RadioButton("1/4", &AOResolutionScale, 4);
+        ImGui::Text("Occlusion Path: "); ImGui::SameLine();
+        ImGui::RadioButton("Fragment", &AOPath, OCCLUSION_FRAGMENT); ImGui::SameLine();
+        if (computeAOSupported)
+            ImGui::RadioButton("Compute", &AOPath, OCCLUSION_COMPUTE);
+        else
+            ImGui::TextDisabled("Compute (needs GL 4.3)");
+        ImGui::Text("Occlusion + blur: fragment %.3f ms, compute %.3f ms", occlusionPathMs[OCCLUSION_FRAGMENT], occlusionPathMs[OCCLUSION_COMPUTE]);
+        ImGui::Checkbox("Shader Permutations", &OcclusionPermutations); ImGui::SameLine();
+        ImGui::Text("%d occlusion variants, %.1f ms compiling", occlusionShaders.GetCount(), occlusionShaders.GetCompileMs());
         ImGui::SliderInt("SSAO Kernel Size", &ssaoKernelSize, 1, 128);
+        ImGui::Text("Kernel: "); ImGui::SameLine();
+        for (int distribution = 0; distribution < KERNEL_DISTRIBUTION_COUNT; ++distribution)
+        {
+            if (distribution > 0)
+                ImGui::SameLine();
+            ImGui::RadioButton(GetKernelDistributionName(distribution), &KernelType, distribution);
+        }
+        ImGui::Checkbox("Temporal", &SSAOTemporal);
+        if (SSAOTemporal)
+        {
+            ImGui::SameLine();
+            ImGui::SliderFloat("Blend", &TemporalBlend, 0.02f, 1.f);
+        }
+        ImGui::Checkbox("Adaptive Taps", &AOAdaptive); ImGui::SameLine();
+        ImGui::Checkbox("Tap Heatmap", &AOHeatmap);
+        if (AOAdaptive)
+        {
+            ImGui::SliderFloat("Full Taps Radius (px)", &AdaptiveFullRadius, 4.f, 256.f);
+            ImGui::SliderFloat("Falloff Depth", &AdaptiveFalloffDepth, 1.f, 50.f);
+            ImGui::SliderFloat("Convergence", &AdaptiveTolerance, 0.005f, 0.2f);
+        }
+        ImGui::SliderInt("HBAO Directions", &HBAODirections, 1, 16);
+        ImGui::SliderInt("HBAO Steps", &HBAOSteps, 1, 16);
         ImGui::SliderFloat("SSAO Radius", &SSAORadius, 0.f, 2.f);
         ImGui::SliderFloat("SSAO Power", &SSAOPower, 0.f, 5.f);
         ImGui::Checkbox("Enable Blur", &SSAOEnableBlur); ImGui::SameLine();
         ImGui::Checkbox("Range Check", &SSAORangeCheck);
+        ImGui::Text("Blur: "); ImGui::SameLine();
+        ImGui::RadioButton("Box 4x4", &SSAOBlurMode, 0); ImGui::SameLine();
+        ImGui::RadioButton("Bilateral", &SSAOBlurMode, 1);
+        if (SSAOBlurMode == 1)
+            ImGui::SliderInt("Blur Radius", &SSAOBlurRadius, 1, 8);
+        ImGui::Text("G-Buffer: "); ImGui::SameLine();
+        ImGui::RadioButton("RGBA16F", &GBufferProfile, GBUFFER_REFERENCE); ImGui::SameLine();
+        ImGui::RadioButton("Oct RG16", &GBufferProfile, GBUFFER_OCT16); ImGui::SameLine();
+        ImGui::RadioButton("Oct RG8", &GBufferProfile, GBUFFER_OCT8);
+        ImGui::Text("G-buffer traffic  write  read  AO   MB/frame%s", materialHasAlbedo ? "" : " (albedo dropped)");
+        for (int profile = 0; profile < GBUFFER_PROFILE_COUNT; ++profile)
+        {
+            GBufferBandwidth bandwidth = GetGBufferBandwidth(GetGBufferLayout(profile), materialHasAlbedo);
+            ImGui::Text("%c %-16s %5d %5d %3d %8.2f", profile == GBufferProfile ? '*' : ' ', GetGBufferLayout(profile).name,
+                bandwidth.geometryWrite, bandwidth.lightingRead, bandwidth.aoWrite, bandwidth.MegabytesPerFrame(renderWidth, renderHeight));
+        }
+        ImGui::Checkbox("Dynamic Resolution", &DynamicResolutionEnabled); ImGui::SameLine();
+        if (DynamicResolutionEnabled)
+            ImGui::SliderFloat("GPU Budget (ms)", &FrameBudgetMs, 1.f, 33.f);
+        else if (ImGui::SliderFloat("Render Scale", &RenderScale, DynamicResolution::MinScale, DynamicResolution::MaxScale))
+            RenderScale = DynamicResolution::Quantize(RenderScale);
+        ImGui::Text("Render scale %.2f (%dx%d), GPU %.2f ms of %.2f, headroom %.2f ms", RenderScale, renderWidth, renderHeight,
+            resolution.GetSmoothedMs(), FrameBudgetMs, resolution.GetHeadroomMs());
+        const TexturePool& targetPool = targets.GetPool();
+        ImGui::Text("Render targets: %.1f MB live, %d pooled, %d allocated, %d reused%s",
+            targets.GetLiveBytes() / (1024.0 * 1024.0), targetPool.GetFreeCount(), targetPool.GetAllocationCount(), targetPool.GetReuseCount(),
+            targetPool.IsImmutable() ? "" : " (mutable)");
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        ImGui::Text("GPU pass        min     avg     max (ms)");
+        for (int pass = 0; pass < PASS_COUNT; ++pass)
+        {
+            ImGui::Text("%-12s %7.3f %7.3f %7.3f", gpuTimer.GetPassName(pass).c_str(),
+                gpuTimer.GetMin(pass), gpuTimer.GetAvg(pass), gpuTimer.GetMax(pass));
+        }
+        if (ImGui::Checkbox("Record CSV", &RecordTimingCsv))
+        {
+            if (RecordTimingCsv)
+                RecordTimingCsv = gpuTimer.OpenCsv(TimingCsvPath);
+            else
+                gpuTimer.CloseCsv();
+        }
+        ImGui::SameLine(); ImGui::Text("%s", TimingCsvPath.c_str());
+        ImGui::Text("Uniform cache misses: %u", Shader::getTotalUniformCacheMisses());
+        ImGui::Text("Program cache: %s start, shaders %.1f ms, %d cached, %d compiled", !programCache.IsEnabled() ? "off" : warmStart ? "warm" : "cold",
+            shaderStartupMs, programCache.GetHits(), programCache.GetMisses());
         ImGui::End();
 
         // Rendering
@@ -419,6 +1361,140 @@ int main(int argc, char* argv[])
         glfwPollEvents();
     }
 
+    if (HeadlessMode)
+    {
+        glFinish();
+        double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+        std::cout << "Headless: " << frameIndex << " frames, " << totalMs / (frameIndex > 0 ? frameIndex : 1)
+                  << " ms/frame (" << screenWidth << "x" << screenHeight << ", render scale " << RenderScale << ", "
+                  << (AOPath == OCCLUSION_COMPUTE ? "compute" : "fragment") << " occlusion path, " << geometryDraws << " geometry draws)" << std::endl;
+        std::cout << "Overdraw: " << (DepthPrepass ? prepassOverdraw.GetOverdraw() : geometryOverdraw.GetOverdraw()) << " fragments/pixel pass the depth test, "
+                  << geometryOverdraw.GetOverdraw() << " shaded into the G-buffer (depth pre-pass " << (DepthPrepass ? "on" : "off") << ")" << std::endl;
+        for (int pass = 0; pass < PASS_COUNT; ++pass)
+        {
+            std::cout << "  " << gpuTimer.GetPassName(pass) << ": min " << gpuTimer.GetMin(pass) << " avg " << gpuTimer.GetAvg(pass)
+                      << " max " << gpuTimer.GetMax(pass) << " ms" << std::endl;
+        }
+        std::cout << "Occlusion shader: " << occlusionShaders.GetCount() << " variant(s), " << occlusionShaders.GetCompileMs()
+                  << " ms compiling" << std::endl;
+        std::cout << "G-buffer bandwidth at " << renderWidth << "x" << renderHeight << " (geometry write, lighting read, AO write in B/px):" << std::endl;
+        for (int profile = 0; profile < GBUFFER_PROFILE_COUNT; ++profile)
+        {
+            GBufferBandwidth bandwidth = GetGBufferBandwidth(GetGBufferLayout(profile), materialHasAlbedo);
+            std::cout << (profile == GBufferProfile ? "* " : "  ") << GetGBufferLayout(profile).name << ": " << bandwidth.geometryWrite << ", "
+                      << bandwidth.lightingRead << ", " << bandwidth.aoWrite << " = " << bandwidth.MegabytesPerFrame(renderWidth, renderHeight)
+                      << " MB/frame" << std::endl;
+        }
+        WriteFramebufferPPM(HeadlessOutput + "_final.ppm", outputFBO, screenWidth, screenHeight);
+        WriteTexturePGM(HeadlessOutput + "_ao.pgm", aoResult, renderWidth, renderHeight);
+        if (AOHeatmap)
+        {
+            // the AO result holds taps taken / full tap count per pixel
+            std::vector<float> tapShare(renderWidth * renderHeight);
+            glBindTexture(GL_TEXTURE_2D, aoResult);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, &tapShare[0]);
+            double sum = 0.0;
+            for (float share : tapShare)
+                sum += share;
+            std::cout << "Average taps per pixel: " << 100.0 * sum / tapShare.size() << "% of the full count" << std::endl;
+        }
+        if (CpuReference && (AOResolutionScale != 1 || SSAOBlurMode != 0 || SSAOTemporal || AODeinterleaved || AODepthMips || AOAdaptive || AOHeatmap))
+            std::cout << "CPU reference covers single frame, full resolution AO with the box blur and fixed tap counts only, use --ao-scale 1 --blur box" << std::endl;
+        else if (CpuReference)
+        {
+            // Run the CPU engine on the same G-buffer and parameters as the last GPU frame
+            std::vector<float> depths(renderWidth * renderHeight), positions(renderWidth * renderHeight * 4), normals(renderWidth * renderHeight * 4);
+            std::vector<float> gpuAO(renderWidth * renderHeight), cpuAO(renderWidth * renderHeight), cpuBlur(renderWidth * renderHeight);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glBindTexture(GL_TEXTURE_2D, targets.Get(RT_G_DEPTH));
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, GL_FLOAT, &depths[0]);
+            glBindTexture(GL_TEXTURE_2D, targets.Get(RT_G_NORMAL));
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &normals[0]);
+            if (GetGBufferLayout(GBufferProfile).octahedralNormals)
+            {
+                for (size_t i = 0; i < normals.size(); i += 4)
+                {
+                    glm::vec3 n = DecodeOctahedralNormal(normals[i], normals[i + 1]);
+                    normals[i] = n.x;
+                    normals[i + 1] = n.y;
+                    normals[i + 2] = n.z;
+                }
+            }
+            glBindTexture(GL_TEXTURE_2D, targets.Get(RT_AO_BLUR));
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, &gpuAO[0]);
+
+            // Reconstruct positions at texel centres, as the occlusion shader does
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)screenWidth / (float)screenHeight, 0.1f, 50.0f);
+            glm::mat4 invProjection = glm::inverse(projection);
+            for (int y = 0; y < renderHeight; ++y)
+            {
+                for (int x = 0; x < renderWidth; ++x)
+                {
+                    size_t i = (size_t)y * renderWidth + x;
+                    glm::vec4 ndc = glm::vec4(((float)x + 0.5f) / renderWidth * 2.0f - 1.0f, ((float)y + 0.5f) / renderHeight * 2.0f - 1.0f,
+                                              depths[i] * 2.0f - 1.0f, 1.0f);
+                    glm::vec4 viewPos = invProjection * ndc;
+                    positions[i * 4 + 0] = viewPos.x / viewPos.w;
+                    positions[i * 4 + 1] = viewPos.y / viewPos.w;
+                    positions[i * 4 + 2] = viewPos.z / viewPos.w;
+                    positions[i * 4 + 3] = 1.0f;
+                }
+            }
+            CpuSSAOParams params;
+            params.aoMethod = AOMethod;
+            params.kernelSize = ssaoKernelSize;
+            params.radius = SSAORadius;
+            params.rangeCheck = SSAORangeCheck;
+            params.power = SSAOPower;
+            params.projection = glm::value_ptr(projection);
+            params.samples = &ssaoKernel[0].x;
+            params.hemisphereKernel = IsHemisphereKernel(KernelType);
+            params.hbaoDirections = HBAODirections;
+            params.hbaoSteps = HBAOSteps;
+            params.noise = &ssaoNoise[0].x;
+            params.noiseSize = NOISE_TEXTURE_SIZE;
+            params.noiseScaleX = (float)renderWidth / NOISE_TEXTURE_SIZE;
+            params.noiseScaleY = (float)renderHeight / NOISE_TEXTURE_SIZE;
+
+            CpuSSAO cpuSSAO;
+            cpuSSAO.Occlusion(&positions[0], &normals[0], 4, renderWidth, renderHeight, params, &cpuAO[0]);
+            cpuSSAO.Blur(&cpuAO[0], renderWidth, renderHeight, SSAOEnableBlur, &cpuBlur[0]);
+            WriteValuesPGM(HeadlessOutput + "_ao_cpu.pgm", &cpuBlur[0], renderWidth, renderHeight);
+            double maxError = 0.0, sumError = 0.0;
+            for (size_t i = 0; i < cpuBlur.size(); ++i)
+            {
+                double error = std::abs((double)cpuBlur[i] - (double)gpuAO[i]);
+                maxError = error > maxError ? error : maxError;
+                sumError += error;
+            }
+            std::cout << "CPU reference (" << CpuSSAO::GetSimdName() << "): max |GPU - CPU| " << maxError
+                      << ", mean " << sumError / cpuBlur.size() << std::endl;
+
+            // Thread scaling of occlusion + blur at the current resolution
+            unsigned int maxThreads = std::thread::hardware_concurrency();
+            maxThreads = maxThreads > 0 ? maxThreads : 1;
+            double singleThreadMs = 0.0;
+            std::cout << "threads, ms, speedup" << std::endl;
+            for (unsigned int threads = 1; threads <= maxThreads; ++threads)
+            {
+                cpuSSAO.SetThreadCount(threads);
+                const int runs = 3;
+                auto start = std::chrono::steady_clock::now();
+                for (int run = 0; run < runs; ++run)
+                {
+                    cpuSSAO.Occlusion(&positions[0], &normals[0], 4, renderWidth, renderHeight, params, &cpuAO[0]);
+                    cpuSSAO.Blur(&cpuAO[0], renderWidth, renderHeight, SSAOEnableBlur, &cpuBlur[0]);
+                }
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+                if (threads == 1)
+                    singleThreadMs = ms;
+                std::cout << threads << ", " << ms << ", " << singleThreadMs / ms << std::endl;
+            }
+        }
+        return 0; // GL objects above are released before headlessContext goes away
+    }
+
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -430,6 +1506,11 @@ int main(int argc, char* argv[])
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
+    // a minimized window reports 0x0: keep the last size instead of allocating empty targets
+    if (width <= 0 || height <= 0)
+        return;
+    screenWidth = width;
+    screenHeight = height;
     glViewport(0, 0, width, height);
 }
 
@@ -592,25 +1673,32 @@ void renderQuad()
     glBindVertexArray(0);
 }
 
+// Defines of the occlusion variant for the current settings (see Shaders/SSAOParams.glsl); none selects the
+// generic variant. The SSAO loop bound is the kernel size rounded up to a power of two, so the slider maps onto
+// a handful of variants.
+std::vector<ShaderDefine> GetOcclusionDefines()
+{
+    std::vector<ShaderDefine> defines;
+    if (!OcclusionPermutations)
+        return defines;
+    defines.push_back({ "AO_METHOD", std::to_string(AOMethod) });
+    if (AOMethod != 1)
+        return defines; // range check and kernel size only matter to SSAO
+    defines.push_back({ "RANGE_CHECK", SSAORangeCheck ? "1" : "0" });
+    if (AOAdaptive)
+        return defines; // adaptive tap counts keep the runtime bound
+    int bucket = 8;
+    while (bucket < ssaoKernelSize)
+        bucket *= 2;
+    defines.push_back({ "KERNEL_TAPS", std::to_string(bucket) });
+    if (bucket == ssaoKernelSize)
+        defines.push_back({ "KERNEL_TAPS_EXACT", "1" });
+    return defines;
+}
+
+// Regenerates the kernel for the current distribution and size. Temporal mode keeps the full table and walks
+// interleaved subsets of it, so its size does not follow the slider.
 void UpdateSSAOKernel()
 {
-    ssaoKernel.clear();
-    auto lerp = [](float a, float b, float f) -> float
-    {
-        return a + f * (b - a);
-    };
-    for (int i = 0; i < ssaoKernelSize; ++i)
-    {
-        glm::vec3 sample = glm::vec3(
-            randomFloats(generator) * 2 - 1.f,
-            randomFloats(generator) * 2 - 1.f,
-            randomFloats(generator)  // todo: change it to (-1, 1) to implement real SSAO 
-        );
-        sample = glm::normalize(sample);
-        sample *= randomFloats(generator);
-        float scale = (float)i / (float)ssaoKernelSize;
-        scale = lerp(0.1f, 1.0f, scale * scale);
-        sample *= sample;
-        ssaoKernel.push_back(sample);
-    }
+    GenerateSSAOKernel(KernelType, SSAOTemporal ? MAX_KERNEL_SIZE : ssaoKernelSize, ssaoKernel);
 }
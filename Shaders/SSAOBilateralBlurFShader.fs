@@ -0,0 +1,46 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D ssaoInput; // r: AO, g: linear depth, ba: octahedral normal
+uniform ivec2 direction;     // (1, 0) for the horizontal pass, (0, 1) for the vertical one
+uniform int blurRadius;
+
+// depth differences are taken relative to the centre depth
+const float depthSharpness = 32.0f;
+const float normalPower = 8.0f;
+
+vec3 octDecode(vec2 e)
+{
+   vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+   if (n.z < 0.0f)
+      n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+   return normalize(n);
+}
+
+// One axis of a separable depth/normal aware gaussian; the output keeps depth and normal for the next axis
+void main()
+{
+   ivec2 size = textureSize(ssaoInput, 0);
+   ivec2 texel = ivec2(gl_FragCoord.xy);
+   vec4 center = texelFetch(ssaoInput, texel, 0);
+   vec3 centerNormal = octDecode(center.ba);
+   float sigma = float(blurRadius) * 0.5f + 0.5f;
+   float falloff = 1.0f / (2.0f * sigma * sigma);
+   float invDepth = depthSharpness / max(center.g, 1e-3f);
+
+   float result = center.r;
+   float weightSum = 1.0f;
+   for (int i = 1; i <= blurRadius; ++i)
+   {
+      float spatial = float(i * i) * falloff;
+      vec4 tapA = texelFetch(ssaoInput, clamp(texel + direction * i, ivec2(0), size - 1), 0);
+      vec4 tapB = texelFetch(ssaoInput, clamp(texel - direction * i, ivec2(0), size - 1), 0);
+      float dzA = (tapA.g - center.g) * invDepth;
+      float dzB = (tapB.g - center.g) * invDepth;
+      float wA = exp(-spatial - dzA * dzA) * pow(max(dot(octDecode(tapA.ba), centerNormal), 0.0f), normalPower);
+      float wB = exp(-spatial - dzB * dzB) * pow(max(dot(octDecode(tapB.ba), centerNormal), 0.0f), normalPower);
+      result += tapA.r * wA + tapB.r * wB;
+      weightSum += wA + wB;
+   }
+   FragColor = vec4(result / weightSum, center.gba);
+}
@@ -0,0 +1,45 @@
+#version 330 core
+layout (location = 0) out float depth0;
+layout (location = 1) out float depth1;
+layout (location = 2) out float depth2;
+layout (location = 3) out float depth3;
+layout (location = 4) out float depth4;
+layout (location = 5) out float depth5;
+layout (location = 6) out float depth6;
+layout (location = 7) out float depth7;
+
+uniform sampler2D gDepth;
+uniform int firstLayer; // 0 writes layers 0-7, 8 writes layers 8-15
+
+layout (std140) uniform Camera
+{
+   mat4 projection;
+   mat4 view;
+   mat4 invProjection;
+};
+
+// positive view space distance along -z from a depth buffer value
+float linearDepth(float depth)
+{
+   return projection[3][2] / (depth * 2.0f - 1.0f + projection[2][2]);
+}
+
+float layerDepth(int layer)
+{
+   ivec2 texel = min(ivec2(gl_FragCoord.xy) * 4 + ivec2(layer & 3, layer >> 2), textureSize(gDepth, 0) - 1);
+   return linearDepth(texelFetch(gDepth, texel, 0).r);
+}
+
+// Splits linear depth into 16 quarter resolution layers: layer (y % 4) * 4 + x % 4 holds every pixel with that
+// position in its 4x4 cell, so one layer's AO taps land on neighbouring texels of a small texture
+void main()
+{
+   depth0 = layerDepth(firstLayer + 0);
+   depth1 = layerDepth(firstLayer + 1);
+   depth2 = layerDepth(firstLayer + 2);
+   depth3 = layerDepth(firstLayer + 3);
+   depth4 = layerDepth(firstLayer + 4);
+   depth5 = layerDepth(firstLayer + 5);
+   depth6 = layerDepth(firstLayer + 6);
+   depth7 = layerDepth(firstLayer + 7);
+}
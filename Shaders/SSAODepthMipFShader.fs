@@ -0,0 +1,33 @@
+#version 330 core
+out float FragColor;
+
+uniform sampler2D gDepth;       // depth buffer at AO resolution
+uniform sampler2D depthPyramid; // linear depth; GL_TEXTURE_BASE_LEVEL is set to the level being read
+uniform int level;              // 0 linearizes the depth buffer, n > 0 reduces level n - 1
+
+layout (std140) uniform Camera
+{
+   mat4 projection;
+   mat4 view;
+   mat4 invProjection;
+};
+
+// positive view space distance along -z from a depth buffer value
+float linearDepth(float depth)
+{
+   return projection[3][2] / (depth * 2.0f - 1.0f + projection[2][2]);
+}
+
+// One level of the linear depth pyramid. Levels above 0 keep one source texel out of each 2x2 block, picked on a
+// rotated grid (as in SAO) so no direction is favoured; averaging would invent depths across silhouettes.
+void main()
+{
+   ivec2 texel = ivec2(gl_FragCoord.xy);
+   if (level == 0)
+   {
+      FragColor = linearDepth(texelFetch(gDepth, texel, 0).r);
+      return;
+   }
+   ivec2 source = min(texel * 2 + ivec2(texel.y & 1, texel.x & 1), textureSize(depthPyramid, 0) - 1);
+   FragColor = texelFetch(depthPyramid, source, 0).r;
+}
@@ -0,0 +1,6 @@
+#version 330 core
+// Depth pre-pass: the depth test and write are the whole pass, no color is written
+
+void main()
+{
+}
@@ -0,0 +1,34 @@
+#version 330 core
+layout (location = 0) out float aoDepth;
+layout (location = 1) out vec4 aoNormal;
+
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+uniform int scale;
+
+// Checkerboard min/max: even cells keep the nearest texel of their scale x scale block, odd cells the farthest,
+// so both sides of a silhouette survive in the low resolution guide
+void main()
+{
+   ivec2 lowTexel = ivec2(gl_FragCoord.xy);
+   ivec2 fullMax = textureSize(gDepth, 0) - 1;
+   bool keepFarthest = ((lowTexel.x + lowTexel.y) & 1) == 1;
+
+   ivec2 best = min(lowTexel * scale, fullMax);
+   float bestDepth = texelFetch(gDepth, best, 0).r;
+   for (int y = 0; y < scale; ++y)
+   {
+      for (int x = 0; x < scale; ++x)
+      {
+         ivec2 texel = min(lowTexel * scale + ivec2(x, y), fullMax);
+         float depth = texelFetch(gDepth, texel, 0).r;
+         if (keepFarthest ? depth > bestDepth : depth < bestDepth)
+         {
+            bestDepth = depth;
+            best = texel;
+         }
+      }
+   }
+   aoDepth = bestDepth;
+   aoNormal = texelFetch(gNormal, best, 0); // copied as stored, in the same format
+}
@@ -1,20 +1,30 @@
 #version 330 core
-layout (location = 0) out vec3 gPosition;
-layout (location = 1) out vec3 gNormal;
-layout (location = 2) out vec3 gAlbedo;
+layout (location = 0) out vec3 gNormal; // xyz, or octahedral remapped to [0, 1] in .xy
+layout (location = 1) out vec3 gAlbedo;
 
 in vec2 TexCoords;
-in vec3 FragPos;
 in vec3 Normal;
 
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
+uniform bool octahedralNormals;
+uniform vec3 constantAlbedo;
+
+vec2 octEncode(vec3 n)
+{
+   n /= abs(n.x) + abs(n.y) + abs(n.z);
+   vec2 e = n.xy;
+   if (n.z < 0.0f)
+      e = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+   return e;
+}
 
 void main()
 {
-   gPosition = FragPos;
-   gNormal = normalize(Normal);
-   gAlbedo.rgb = vec3(0.55);
+   vec3 normal = normalize(Normal);
+   gNormal = octahedralNormals ? vec3(octEncode(normal) * 0.5f + 0.5f, 0.0f) : normal;
+   // dropped from the G-buffer while the material set leaves it constant
+   gAlbedo.rgb = constantAlbedo;
    //gAlbedo.rgb = texture(texture_diffuse1, TexCoords).rgb;
    //store specular intensity in gAlbedoSpec's alpha component
    //gAlbedo.a = texture(texture_specular1, TexCoords).r;
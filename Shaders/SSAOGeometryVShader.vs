@@ -2,24 +2,51 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#ifdef INSTANCED
+// per instance (Includes/InstanceBuffer.h)
+layout (location = 7) in mat4 instanceModel;
+layout (location = 11) in mat3 instanceNormalMatrix;
+#endif
 
-out vec3 FragPos;
+#ifndef DEPTH_ONLY
 out vec2 TexCoords;
 out vec3 Normal;
+#endif
+// DEPTH_ONLY (depth pre-pass) shares the position math, so its depth matches the G-buffer pass for GL_EQUAL
+invariant gl_Position;
+
+layout (std140) uniform Camera
+{
+	mat4 projection;
+	mat4 view;
+	mat4 invProjection;
+};
 
 uniform bool invertedNormals;
+// maps quantized positions (unit cube of the model bounds) back to model space; identity for float positions
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+#ifndef INSTANCED
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
 
 void main()
 {
-	vec4 viewPos = view * model * vec4(aPos, 1.0f);
-	FragPos = viewPos.xyz;
+	vec3 position = positionOffset + positionScale * aPos;
+#ifdef INSTANCED
+	vec4 viewPos = view * instanceModel * vec4(position, 1.0f);
+	// the view matrix is rigid, so its rotation carries model-space normals into view space unchanged
+	mat3 normalMatrix = mat3(view) * instanceNormalMatrix;
+#else
+	vec4 viewPos = view * model * vec4(position, 1.0f);
+	mat3 normalMatrix = transpose(inverse(mat3(view * model)));
+#endif
+#ifndef DEPTH_ONLY
 	TexCoords = aTexCoords;
 
-	mat3 normalMatrix = transpose(inverse(mat3(view * model)));
+	// quantized normals are only close to unit length; the fragment shader normalizes
 	Normal = normalMatrix * (invertedNormals ? -aNormal : aNormal);
+#endif
 
 	gl_Position = projection * viewPos;
 }
\ No newline at end of file
@@ -3,10 +3,14 @@ out vec4 FragColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D gPosition;
+uniform sampler2D gDepth;
 uniform sampler2D gNormal;
 uniform sampler2D gAlbedo;
 uniform sampler2D ssao;
+uniform bool octahedralNormals;
+uniform bool hasAlbedo;      // false: the G-buffer has no albedo attachment, use constantAlbedo
+uniform vec3 constantAlbedo;
+uniform bool aoHeatmap;      // ssao holds taps per pixel / full tap count: show it instead of the lit scene
 
 struct Light 
 {
@@ -18,27 +22,67 @@ struct Light
    float Radius;
 };
 
-uniform Light light;
+layout (std140) uniform Camera
+{
+   mat4 projection;
+   mat4 view;
+   mat4 invProjection;
+};
+
+uniform Light light; // Position in world space
+
+vec3 octDecode(vec2 e)
+{
+   vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+   if (n.z < 0.0f)
+      n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+   return normalize(n);
+}
+
+// gNormal holds xyz, or an octahedral encoding remapped to [0, 1] in compact G-buffer profiles
+vec3 decodeNormal(vec4 texel)
+{
+   return octahedralNormals ? octDecode(texel.xy * 2.0f - 1.0f) : normalize(texel.xyz);
+}
+
+// view space position from a depth buffer value at screen uv
+vec3 viewPositionFromDepth(vec2 uv, float depth)
+{
+   vec4 viewPos = invProjection * vec4(vec3(uv, depth) * 2.0f - 1.0f, 1.0f);
+   return viewPos.xyz / viewPos.w;
+}
+
+// blue (no taps) through green to red (full tap count)
+vec3 heatmap(float t)
+{
+   return clamp(vec3(2.0f * t - 1.0f, 1.0f - abs(2.0f * t - 1.0f), 1.0f - 2.0f * t), 0.0f, 1.0f);
+}
 
 void main()
 {
-   vec3 FragPos = texture(gPosition, TexCoords).rgb;
-   vec3 Normal = texture(gNormal, TexCoords).rgb;
-   vec3 Diffuse = texture(gAlbedo, TexCoords).rgb;
+   vec3 FragPos = viewPositionFromDepth(TexCoords, texture(gDepth, TexCoords).r);
+   vec3 Normal = decodeNormal(texture(gNormal, TexCoords));
+   vec3 Diffuse = hasAlbedo ? texture(gAlbedo, TexCoords).rgb : constantAlbedo;
    float AmbientOcclusion = texture(ssao, TexCoords).r;
+   if (aoHeatmap)
+   {
+      FragColor = vec4(heatmap(AmbientOcclusion), 1.0);
+      return;
+   }
 
    vec3 ambient = vec3(0.3 * Diffuse * AmbientOcclusion);
    vec3 lighting = ambient;
    vec3 viewDir = normalize(-FragPos);
 
-   vec3 lightDir = normalize(light.Position - FragPos);
+   vec3 lightPos = vec3(view * vec4(light.Position, 1.0));
+   vec3 lightDir = normalize(lightPos - FragPos);
    vec3 diffuse = max(dot(Normal, lightDir), 0.0) * Diffuse * light.Color;
 
    vec3 halfwayDir = normalize(lightDir + viewDir);
    float spec = pow(max(dot(Normal, halfwayDir), 0.0), 8.0);
    vec3 specular = light.Color * spec;
 
-   float dist = length(light.Position - FragPos);
+   float dist = length(lightPos - FragPos);
    float attenuation = 1.0 / (1.0 + light.Linear * dist + light.Quadratic * dist * dist);
    diffuse *= attenuation;
    specular *= attenuation;
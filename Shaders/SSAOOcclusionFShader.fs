@@ -1,55 +1,258 @@
 #version 330 core
-#define MAX_KERNEL_SIZE 128
-out float FragColor;
+out vec4 FragColor; // r: AO, g: linear depth, ba: octahedral normal, so each bilateral blur tap is one fetch
 in vec2 TexCoords;
 
-uniform sampler2D gPosition;
+uniform sampler2D gDepth; // depth buffer at AO resolution
 uniform sampler2D gNormal;
+uniform bool octahedralNormals;
 uniform sampler2D texNoise;
+uniform sampler2D depthPyramid; // linear depth mip chain, used when depthMaxLevel > 0
+// deinterleaved mode: this draw computes one 4x4-cell position (layer) at quarter resolution from its depth layer
+uniform sampler2DArray depthLayers;
+uniform bool deinterleaved;
+uniform int layer;
 
-uniform int aoMethod;
-uniform int kernelSize;
-uniform float radius;
-uniform bool rangeCheck;
-uniform float ssaoPower;
-uniform vec3 samples[MAX_KERNEL_SIZE];
-uniform mat4 projection;
+#include "SSAOParams.glsl"
 
 float bias = 0.025f;
 
-const vec2 noiseScale = vec2(800.0 / 4.0, 600.0 / 4.0);
+// HBAO: angle added to the tangent plane so flat surfaces do not self-occlude
+const float hbaoAngleBias = 0.1f;
+const float PI = 3.14159265f;
+
+// adaptive mode never goes below this many SSAO taps, and tests convergence every this many
+const int adaptiveMinTaps = 8;
+
+// taps within 2^depthMipShift pixels read mip 0, every further doubling of the distance reads one level up
+const int depthMipShift = 3;
+
+ivec2 layerOffset()
+{
+   return ivec2(layer & 3, layer >> 2);
+}
+
+// view space position from linear depth at a screen uv (symmetric perspective projection)
+vec3 viewPosition(vec2 uv, float depth)
+{
+   return vec3((uv * 2.0f - 1.0f) * depth / vec2(projection[0][0], projection[1][1]), -depth);
+}
+
+// view space position from a depth buffer value at screen uv
+vec3 viewPositionFromDepth(vec2 uv, float depth)
+{
+   vec4 viewPos = invProjection * vec4(vec3(uv, depth) * 2.0f - 1.0f, 1.0f);
+   return viewPos.xyz / viewPos.w;
+}
+
+// view space position of the depth buffer texel (reconstructed at its centre)
+vec3 positionAtTexel(ivec2 texel)
+{
+   return viewPositionFromDepth((vec2(texel) + 0.5f) / vec2(textureSize(gDepth, 0)), texelFetch(gDepth, texel, 0).r);
+}
+
+// view space position of the G-buffer texel at uv, tapPixels away from the pixel being shaded. In deinterleaved
+// mode only this layer's texels are visible; with the depth pyramid far taps read coarser, cache friendly levels.
+vec3 fetchPosition(vec2 uv, float tapPixels)
+{
+   if (!deinterleaved)
+   {
+      if (depthMaxLevel == 0)
+      {
+         ivec2 size = textureSize(gDepth, 0);
+         return positionAtTexel(clamp(ivec2(floor(uv * vec2(size))), ivec2(0), size - 1));
+      }
+      int level = clamp(int(log2(max(tapPixels, 1.0f))) - depthMipShift, 0, depthMaxLevel);
+      ivec2 levelSize = textureSize(depthPyramid, level);
+      ivec2 texel = clamp(ivec2(uv * vec2(levelSize)), ivec2(0), levelSize - 1);
+      return viewPosition((vec2(texel) + 0.5f) / vec2(levelSize), texelFetch(depthPyramid, texel, level).r);
+   }
+   ivec2 layerSize = textureSize(depthLayers, 0).xy;
+   ivec2 cell = clamp(ivec2(uv * vec2(layerSize)), ivec2(0), layerSize - 1);
+   float depth = texelFetch(depthLayers, ivec3(cell, layer), 0).r;
+   return viewPosition((vec2(cell * 4 + layerOffset()) + 0.5f) / vec2(textureSize(gDepth, 0)), depth);
+}
+
+vec3 octDecode(vec2 e)
+{
+   vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+   if (n.z < 0.0f)
+      n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+   return normalize(n);
+}
+
+// gNormal holds xyz, or an octahedral encoding remapped to [0, 1] in compact G-buffer profiles
+vec3 decodeNormal(vec4 texel)
+{
+   return octahedralNormals ? octDecode(texel.xy * 2.0f - 1.0f) : normalize(texel.xyz);
+}
+
+vec2 octEncode(vec3 n)
+{
+   n /= abs(n.x) + abs(n.y) + abs(n.z);
+   vec2 e = n.xy;
+   if (n.z < 0.0f)
+      e = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+   return e;
+}
+
+// adaptive mode: fraction of the full tap count a pixel needs
+float adaptiveBudget(float radiusPixels, float depth)
+{
+   return clamp(radiusPixels / adaptiveFullRadius, 0.0f, 1.0f) * clamp(adaptiveFalloffDepth / depth, 0.0f, 1.0f);
+}
+
+// true once the mean of count values in [0, 1] summing to sum is known to within adaptiveTolerance
+bool converged(float sum, int count)
+{
+   float mean = clamp(sum / float(count), 0.0f, 1.0f);
+   return sqrt(mean * (1.0f - mean) / float(count)) < adaptiveTolerance;
+}
+
+// van der Corput sequence: any prefix of the visit order spreads over the whole (radius sorted) kernel
+float radicalInverse(int i)
+{
+   float result = 0.0f, digit = 0.5f;
+   for (; i > 0; i >>= 1, digit *= 0.5f)
+      result += digit * float(i & 1);
+   return result;
+}
+
+// Horizon-based AO: march hbaoDirections screen-space directions (rotated per pixel by the noise texture) for
+// hbaoSteps jittered steps each, and accumulate the rise of the horizon angle above the tangent plane,
+// attenuated by distance. Returns the unoccluded fraction. Adaptive mode shortens the march by the pixel's
+// budget, visits even directions first and stops after them when the estimate has converged.
+float horizonBasedAO(vec2 uv, vec3 fragPos, vec3 normal, vec3 randomVec, out int taps)
+{
+   vec2 size = vec2(textureSize(gDepth, 0));
+   // radius projected to pixels, kept within half the screen height
+   float radiusPixels = min(radius * projection[1][1] * 0.5f * size.y / -fragPos.z, 0.5f * size.y);
+   taps = 0;
+   if (radiusPixels < 1.0f)
+      return 1.0f;
+   int steps = hbaoSteps;
+   if (ADAPTIVE_ON)
+      steps = clamp(int(ceil(float(hbaoSteps) * adaptiveBudget(radiusPixels, -fragPos.z))), min(2, hbaoSteps), hbaoSteps);
+   float stepPixels = radiusPixels / float(steps + 1);
+   float jitter = randomVec.x * 0.5f + 0.5f;
+   float radius2 = radius * radius;
+   float nz = abs(normal.z) < 1e-4f ? (normal.z < 0.0f ? -1e-4f : 1e-4f) : normal.z;
+
+   float ao = 0.0f;
+   int halfDirections = (hbaoDirections + 1) / 2;
+   int directions = hbaoDirections;
+   for (int i = 0; i < hbaoDirections; ++i)
+   {
+      int d = ADAPTIVE_ON ? (i < halfDirections ? 2 * i : 2 * (i - halfDirections) + 1) : i;
+      float angle = 2.0f * PI * float(d) / float(hbaoDirections);
+      vec2 baseDir = vec2(cos(angle), sin(angle));
+      vec2 dir = vec2(baseDir.x * randomVec.x - baseDir.y * randomVec.y, baseDir.x * randomVec.y + baseDir.y * randomVec.x);
+      // slope of the tangent plane along dir: view space z rise per unit of screen-aligned xy
+      float tangentSlope = -(normal.x * dir.x + normal.y * dir.y) / nz;
+      float maxSin = sin(atan(tangentSlope) + hbaoAngleBias);
+      for (int s = 1; s <= steps; ++s)
+      {
+         float tapPixels = (float(s) + jitter) * stepPixels;
+         vec2 sampleUV = uv + dir * tapPixels / size;
+         vec3 D = fetchPosition(sampleUV, tapPixels) - fragPos;
+         float d2 = dot(D, D);
+         if (d2 >= radius2 || d2 <= 1e-8f)
+            continue;
+         // elevation towards the viewer (+z in view space)
+         float sinH = D.z / sqrt(d2);
+         if (sinH > maxSin)
+         {
+            ao += (1.0f - d2 / radius2) * (sinH - maxSin);
+            maxSin = sinH;
+         }
+      }
+      if (ADAPTIVE_ON && i + 1 == halfDirections && halfDirections >= 4 && converged(ao, halfDirections))
+      {
+         directions = halfDirections;
+         break;
+      }
+   }
+   taps = directions * steps;
+   return clamp(1.0f - ao / float(directions), 0.0f, 1.0f);
+}
 
 void main()
 {
-   if (aoMethod == 0)
+   vec2 uv = TexCoords;
+   vec3 fragPos, normal, randomVec;
+   if (deinterleaved)
    {
-      FragColor = 1;
+      // one constant rotation per layer keeps neighbouring pixels of the layer sampling the same pattern
+      ivec2 texel = min(ivec2(gl_FragCoord.xy) * 4 + layerOffset(), textureSize(gDepth, 0) - 1);
+      uv = (vec2(texel) + 0.5f) / vec2(textureSize(gDepth, 0));
+      fragPos = positionAtTexel(texel);
+      normal = decodeNormal(texelFetch(gNormal, texel, 0));
+      randomVec = normalize(texelFetch(texNoise, layerOffset(), 0).xyz);
+   }
+   else
+   {
+      fragPos = positionAtTexel(ivec2(gl_FragCoord.xy));
+      normal = decodeNormal(texture(gNormal, uv));
+      // one noise texel per pixel of the target, whatever its size
+      vec2 noiseScale = vec2(textureSize(gDepth, 0)) / vec2(textureSize(texNoise, 0));
+      randomVec = normalize(texture(texNoise, uv * noiseScale).xyz);
+   }
+   if (AO_METHOD_IS(0))
+   {
+      FragColor = vec4(aoHeatmap ? 0.0f : 1.0f, -fragPos.z, octEncode(normal));
+      return;
+   }
+   float rotationCos = cos(noiseRotation), rotationSin = sin(noiseRotation);
+   randomVec.xy = vec2(rotationCos * randomVec.x - rotationSin * randomVec.y, rotationSin * randomVec.x + rotationCos * randomVec.y);
+   if (AO_METHOD_IS(2))
+   {
+      int taps;
+      float ao = pow(horizonBasedAO(uv, fragPos, normal, randomVec, taps), ssaoPower);
+      FragColor = vec4(aoHeatmap ? float(taps) / float(hbaoDirections * hbaoSteps) : ao, -fragPos.z, octEncode(normal));
       return;
    }
-   vec3 fragPos = texture(gPosition, TexCoords).xyz;
-   vec3 normal = normalize(texture(gNormal, TexCoords).rgb);
-   vec3 randomVec = normalize(texture(texNoise, TexCoords * noiseScale).xyz);
 
    vec3 tangent = normalize(randomVec - normal* dot(randomVec, normal));
    vec3 bitangent = cross(normal, tangent);
    mat3 TBN = mat3(tangent, bitangent, normal);
 
    float occlusion = 0.0f;
+   vec2 size = vec2(textureSize(gDepth, 0));
+   int taps = kernelSize;
+   if (ADAPTIVE_ON)
+   {
+      float radiusPixels = radius * projection[1][1] * 0.5f * size.y / -fragPos.z;
+      taps = clamp(int(ceil(float(kernelSize) * adaptiveBudget(radiusPixels, -fragPos.z))), min(adaptiveMinTaps, kernelSize), kernelSize);
+   }
 
-   for (int i=0; i < kernelSize; ++i)
+#ifdef KERNEL_TAPS
+   // constant bound: the loop can be unrolled, and only a kernel smaller than its bucket tests for the end
+   for (int i = 0; i < KERNEL_TAPS; ++i)
+#else
+   for (int i = 0; i < taps; ++i)
+#endif
    {
-      vec3 samplePos = TBN * samples[i];
+#if defined(KERNEL_TAPS) && !defined(KERNEL_TAPS_EXACT)
+      if (i >= taps)
+         break;
+#endif
+      int k = ADAPTIVE_ON ? min(int(radicalInverse(i) * float(kernelSize)), kernelSize - 1) : i;
+      vec3 samplePos = TBN * samples[k * kernelStride + kernelPhase].xyz;
       samplePos = fragPos + samplePos * radius;
       vec4 offset = vec4(samplePos, 1.f);
       offset = projection * offset;
       offset.xyz /= offset.w;
       offset.xyz = offset.xyz * 0.5f + 0.5f;
-      float sampleDepth = texture(gPosition, offset.xy).z;
-      float rangeCheckValue = rangeCheck ? smoothstep(0.f, 1.f, radius / abs(sampleDepth - samplePos.z)) : 1.0f;
+      float sampleDepth = fetchPosition(offset.xy, length((offset.xy - uv) * size)).z;
+      float rangeCheckValue = RANGE_CHECK_ON ? smoothstep(0.f, 1.f, radius / abs(sampleDepth - samplePos.z)) : 1.0f;
       occlusion += ((sampleDepth >= samplePos.z + bias) ? 1.0f : 0.0f) * rangeCheckValue;
+      if (ADAPTIVE_ON && (i + 1) % adaptiveMinTaps == 0 && converged(occlusion, i + 1))
+      {
+         taps = i + 1;
+         break;
+      }
    }
-   occlusion = 1.0 - (occlusion / kernelSize);
-   if (aoMethod == 1 && occlusion >= 0.5f)
+   occlusion = 1.0 - (occlusion / taps);
+   if (occlusion >= 0.5f && !kernelHemisphere)
    {
       occlusion = 1.0f;
    }
@@ -57,5 +260,5 @@ void main()
    {
       occlusion = pow(occlusion, ssaoPower);
    }
-   FragColor = occlusion;
+   FragColor = vec4(aoHeatmap ? float(taps) / float(kernelSize) : occlusion, -fragPos.z, octEncode(normal));
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+// Uniform blocks and permutation switches shared by the occlusion shaders (fragment and compute)
+#define MAX_KERNEL_SIZE 128
+
+layout (std140) uniform Camera
+{
+   mat4 projection;
+   mat4 view;
+   mat4 invProjection;
+};
+
+layout (std140) uniform SSAOKernel
+{
+   vec4 samples[MAX_KERNEL_SIZE];
+};
+
+layout (std140) uniform AOParams
+{
+   int aoMethod;
+   int kernelSize;
+   float radius;
+   bool rangeCheck;
+   float ssaoPower;
+   int hbaoDirections;
+   int hbaoSteps;
+   // temporal mode: per-frame noise rotation and kernel subset (samples[i * kernelStride + kernelPhase])
+   float noiseRotation;
+   int kernelStride;
+   int kernelPhase;
+   int depthMaxLevel;
+   // adaptive mode: tap count from the projected radius and view depth, with early exit on convergence
+   bool adaptiveSamples;
+   float adaptiveFullRadius;   // projected radius in pixels that gets the full tap count
+   float adaptiveFalloffDepth; // view depth beyond which the tap count falls off as 1 / depth
+   float adaptiveTolerance;    // standard error of the running estimate that ends the loop
+   bool aoHeatmap;             // r holds taps taken / full tap count instead of AO
+   // hemisphere kernels leave flat surfaces unoccluded; the legacy sphere kernel half-occludes them, so its
+   // results above one half are flattened to 1
+   bool kernelHemisphere;
+};
+
+// Permutation defines, injected by the loader: each turns a block member into a constant so the compiler drops
+// the branches on it. Without them the shader reads the uniforms and covers every setting.
+//   AO_METHOD          0: none, 1: SSAO, 2: HBAO
+//   RANGE_CHECK        0 or 1
+//   KERNEL_TAPS        constant bound of the SSAO loop, a power of two >= kernelSize; fixed tap counts only
+//   KERNEL_TAPS_EXACT  kernelSize == KERNEL_TAPS, so the loop needs no exit test
+#ifdef AO_METHOD
+#define AO_METHOD_IS(method) (AO_METHOD == (method))
+#else
+#define AO_METHOD_IS(method) (aoMethod == (method))
+#endif
+#ifdef RANGE_CHECK
+#define RANGE_CHECK_ON (RANGE_CHECK != 0)
+#else
+#define RANGE_CHECK_ON rangeCheck
+#endif
+#ifdef KERNEL_TAPS
+#define ADAPTIVE_ON false
+#else
+#define ADAPTIVE_ON adaptiveSamples
+#endif
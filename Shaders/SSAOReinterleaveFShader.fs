@@ -0,0 +1,11 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2DArray aoLayers; // per-layer occlusion output: r: AO, g: linear depth, ba: octahedral normal
+
+// Puts every pixel back from the layer of its 4x4 cell position
+void main()
+{
+   ivec2 texel = ivec2(gl_FragCoord.xy);
+   FragColor = texelFetch(aoLayers, ivec3(texel >> 2, (texel.y & 3) * 4 + (texel.x & 3)), 0);
+}
@@ -0,0 +1,82 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D ssaoInput; // this frame's occlusion: r: AO, g: linear depth, ba: octahedral normal
+uniform sampler2D aoHistory; // accumulated AO of the previous frame, same layout in the previous view
+uniform sampler2D gDepth;    // depth buffer at AO resolution
+
+uniform mat4 viewToPrevView; // previous view * inverse(current view)
+uniform mat4 prevProjection;
+uniform float blendFactor;   // weight of this frame in the exponential moving average
+uniform bool historyValid;
+
+// relative depth difference and normal agreement a history tap needs to count as the same surface
+const float depthTolerance = 0.05f;
+const float normalThreshold = 0.9f;
+
+layout (std140) uniform Camera
+{
+   mat4 projection;
+   mat4 view;
+   mat4 invProjection;
+};
+
+// view space position from a depth buffer value at screen uv
+vec3 viewPositionFromDepth(vec2 uv, float depth)
+{
+   vec4 viewPos = invProjection * vec4(vec3(uv, depth) * 2.0f - 1.0f, 1.0f);
+   return viewPos.xyz / viewPos.w;
+}
+
+vec3 octDecode(vec2 e)
+{
+   vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+   if (n.z < 0.0f)
+      n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+   return normalize(n);
+}
+
+// Reprojects the pixel into the previous frame, bilinearly gathers the history taps that still see the same surface
+// and blends them with this frame's AO. Disoccluded or off screen pixels restart from this frame alone.
+void main()
+{
+   ivec2 texel = ivec2(gl_FragCoord.xy);
+   vec4 current = texelFetch(ssaoInput, texel, 0);
+   FragColor = current;
+   if (!historyValid)
+      return;
+
+   vec3 fragPos = viewPositionFromDepth((vec2(texel) + 0.5f) / vec2(textureSize(gDepth, 0)), texelFetch(gDepth, texel, 0).r);
+   vec3 prevPos = (viewToPrevView * vec4(fragPos, 1.0f)).xyz;
+   vec4 prevClip = prevProjection * vec4(prevPos, 1.0f);
+   if (prevClip.w <= 0.0f)
+      return;
+   vec3 prevNormal = mat3(viewToPrevView) * octDecode(current.ba);
+   float prevDepth = -prevPos.z;
+
+   ivec2 size = textureSize(aoHistory, 0);
+   vec2 coord = (prevClip.xy / prevClip.w * 0.5f + 0.5f) * vec2(size) - 0.5f;
+   ivec2 base = ivec2(floor(coord));
+   vec2 f = coord - floor(coord);
+
+   float history = 0.0f;
+   float weightSum = 0.0f;
+   for (int i = 0; i < 4; ++i)
+   {
+      ivec2 offset = ivec2(i & 1, i >> 1);
+      ivec2 tap = base + offset;
+      if (any(lessThan(tap, ivec2(0))) || any(greaterThanEqual(tap, size)))
+         continue;
+      vec4 previous = texelFetch(aoHistory, tap, 0);
+      bool sameSurface = abs(previous.g - prevDepth) < depthTolerance * prevDepth
+         && dot(octDecode(previous.ba), prevNormal) > normalThreshold;
+      if (!sameSurface)
+         continue;
+      float bilinear = (offset.x == 1 ? f.x : 1.0f - f.x) * (offset.y == 1 ? f.y : 1.0f - f.y);
+      history += previous.r * bilinear;
+      weightSum += bilinear;
+   }
+   if (weightSum < 1e-3f)
+      return;
+   FragColor = vec4(mix(history / weightSum, current.r, blendFactor), current.gba);
+}
@@ -0,0 +1,82 @@
+#version 330 core
+out float FragColor;
+in vec2 TexCoords;
+
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+uniform sampler2D aoDepth;
+uniform sampler2D aoNormal;
+uniform sampler2D ssaoInput;
+uniform bool octahedralNormals; // gNormal/aoNormal encoding
+
+// relative depth difference at which a low resolution tap stops contributing
+const float depthTolerance = 0.05f;
+const float normalPower = 8.0f;
+
+layout (std140) uniform Camera
+{
+   mat4 projection;
+   mat4 view;
+   mat4 invProjection;
+};
+
+vec3 octDecode(vec2 e)
+{
+   vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+   if (n.z < 0.0f)
+      n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+   return normalize(n);
+}
+
+// gNormal holds xyz, or an octahedral encoding remapped to [0, 1] in compact G-buffer profiles
+vec3 decodeNormal(vec4 texel)
+{
+   return octahedralNormals ? octDecode(texel.xy * 2.0f - 1.0f) : normalize(texel.xyz);
+}
+
+// positive view space distance along -z from a depth buffer value
+float linearDepth(float depth)
+{
+   return projection[3][2] / (depth * 2.0f - 1.0f + projection[2][2]);
+}
+
+// Joint bilateral upsample: the four low resolution taps around the pixel are weighted bilinearly and by how well
+// their depth and normal match the full resolution G-buffer, so AO does not bleed across silhouettes
+void main()
+{
+   float fragDepth = linearDepth(texture(gDepth, TexCoords).r);
+   vec3 normal = decodeNormal(texture(gNormal, TexCoords));
+
+   ivec2 lowSize = textureSize(ssaoInput, 0);
+   vec2 coord = TexCoords * vec2(lowSize) - 0.5f;
+   ivec2 base = ivec2(floor(coord));
+   vec2 f = coord - floor(coord);
+
+   float result = 0.0f;
+   float weightSum = 0.0f;
+   float bestDepthDiff = 1e30f;
+   float bestAO = 1.0f;
+   for (int i = 0; i < 4; ++i)
+   {
+      ivec2 offset = ivec2(i & 1, i >> 1);
+      ivec2 texel = clamp(base + offset, ivec2(0), lowSize - 1);
+      float ao = texelFetch(ssaoInput, texel, 0).r;
+      float sampleDepth = linearDepth(texelFetch(aoDepth, texel, 0).r);
+      vec3 sampleNormal = decodeNormal(texelFetch(aoNormal, texel, 0));
+
+      float bilinear = (offset.x == 1 ? f.x : 1.0f - f.x) * (offset.y == 1 ? f.y : 1.0f - f.y);
+      float depthDiff = abs(sampleDepth - fragDepth);
+      float depthWeight = max(0.0f, 1.0f - depthDiff / (depthTolerance * fragDepth + 1e-4f));
+      float normalWeight = pow(max(dot(normal, sampleNormal), 0.0f), normalPower);
+      float weight = bilinear * depthWeight * normalWeight;
+      result += ao * weight;
+      weightSum += weight;
+      if (depthDiff < bestDepthDiff)
+      {
+         bestDepthDiff = depthDiff;
+         bestAO = ao;
+      }
+   }
+   // no tap matches this surface (thin feature lost in the downsample): take the closest in depth
+   FragColor = weightSum > 1e-4f ? result / weightSum : bestAO;
+}